@@ -43,15 +43,88 @@
 #define KB_NOTFOUND -1
 #define KB_INVALID  -2
 #define KB_NOMEM    -3
+#define KB_BUSY     -4	/* a shared knowledge base kept changing during the read */
+
+/* one question for knowledge_get_many() */
+typedef struct {
+	const char *intent;
+	const char *entity;
+} KnowledgeKey;
+
+/* everything one chatbot knows (see knowledge.c) */
+typedef struct KnowledgeBase KnowledgeBase;
+
+/* one chatbot: a knowledge base and a conversation with it (see chatbot.c) */
+typedef struct ChatbotContext ChatbotContext;
+
+/* an inverted index over the knowledge base (see search.c) */
+typedef struct SearchIndex SearchIndex;
+
+/* an automaton spotting known entities in free text (see spot.c) */
+typedef struct EntitySpotter EntitySpotter;
+
+/* fixed-width embeddings of the entries, compared by similarity (see vector.c) */
+typedef struct VectorIndex VectorIndex;
+
+/* a fixed-size count of the questions the chatbot could not answer (see misses.c) */
+typedef struct MissTracker MissTracker;
+
+/* one result of misses_top() */
+typedef struct {
+	char intent[MAX_INTENT];
+	char entity[MAX_ENTITY];
+	char question[MAX_INPUT];	// as first asked, without the question mark
+	unsigned long count;
+} MissCount;
+
+/* a knowledge file opened through its offset index (see sidecar.c) */
+typedef struct Sidecar Sidecar;
+
+/* a knowledge base in shared memory, served to other processes (see shared.c) */
+typedef struct SharedKnowledge SharedKnowledge;
+
+/* a transcript of the conversation, written in the background (see transcript.c) */
+typedef struct TranscriptLog TranscriptLog;
+
+/* what transcript_log() does when the transcript cannot keep up */
+#define TRANSCRIPT_DROP  0   /* drop the line and count it */
+#define TRANSCRIPT_BLOCK 1   /* wait for room */
+
+/* one result of search_query() or vector_query() */
+typedef struct {
+	char entity[MAX_ENTITY];
+	double score;
+} SearchHit;
+
+/* states of a conversation */
+#define SESSION_IDLE            0   /* waiting for a question or command */
+#define SESSION_AWAITING_ANSWER 1   /* waiting to be taught the answer to 'intent' and 'entity' */
+
+/* the state of one conversation between lines of input (see chatbot_session_step()) */
+typedef struct {
+	int state;
+	char intent[MAX_INTENT];
+	char entity[MAX_ENTITY];
+} ChatbotSession;
 
 /* functions defined in main.c */
-int compare_token(const char *token1, const char *token2);
 void prompt_user(char *buf, int n, const char *format, ...);
 
 /* functions defined in chatbot.c */
+int compare_token(const char *token1, const char *token2);
+int split_words(char *input, char *inv[], int max);
 const char *chatbot_botname();
 const char *chatbot_username();
 int chatbot_main(int inc, char *inv[], char *response, int n);
+ChatbotContext *chatbot_create(const char *path);
+void chatbot_destroy(ChatbotContext *ctx);
+KnowledgeBase *chatbot_knowledge(ChatbotContext *ctx);
+int chatbot_main_ctx(ChatbotContext *ctx, int inc, char *inv[], char *response, int n);
+int chatbot_step_ctx(ChatbotContext *ctx, char *line, char *response, int n);
+void chatbot_session_init(ChatbotSession *session);
+int chatbot_session_step(ChatbotSession *session, char *line, char *response, int n);
+int chatbot_session_main(ChatbotSession *session, int inc, char *inv[], char *response, int n);
+int chatbot_session_question(ChatbotSession *session, int inc, char *inv[], char *response, int n);
 int chatbot_is_exit(const char *intent);
 int chatbot_do_exit(int inc, char *inv[], char *response, int n);
 int chatbot_is_load(const char *intent);
@@ -62,12 +135,120 @@ int chatbot_is_reset(const char *intent);
 int chatbot_do_reset(int inc, char *inv[], char *response, int n);
 int chatbot_is_save(const char *intent);
 int chatbot_do_save(int inc, char *inv[], char *response, int n);
+int chatbot_is_snapshot(const char *intent);
+int chatbot_do_snapshot(int inc, char *inv[], char *response, int n);
+int chatbot_is_rollback(const char *intent);
+int chatbot_do_rollback(int inc, char *inv[], char *response, int n);
+int chatbot_is_drop(const char *intent);
+int chatbot_do_drop(int inc, char *inv[], char *response, int n);
+int chatbot_is_top(const char *intent);
+int chatbot_do_top(int inc, char *inv[], char *response, int n);
 
 /* functions defined in knowledge.c */
+KnowledgeBase *knowledge_create(const char *path);
+void knowledge_destroy(KnowledgeBase *kb);
+int knowledge_get_ctx(KnowledgeBase *kb, const char *intent, const char *entity, char *response, int n);
+int knowledge_view_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char **response, int *len);
+int knowledge_get_many_ctx(KnowledgeBase *kb, const KnowledgeKey *keys, int count, char *responses[], int n, int results[]);
+int knowledge_put_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char *response);
+void knowledge_reset_ctx(KnowledgeBase *kb);
+int knowledge_read_ctx(KnowledgeBase *kb, FILE *f);
+void knowledge_write_ctx(KnowledgeBase *kb, FILE *f);
+int knowledge_erase_ctx(KnowledgeBase *kb);
+int knowledge_publish_ctx(KnowledgeBase *kb, const char *path);
+int knowledge_follow_ctx(KnowledgeBase *kb, const char *path, const char *snapshot);
+int knowledge_replicate_ctx(KnowledgeBase *kb);
+int knowledge_is_replica_ctx(KnowledgeBase *kb);
+int knowledge_share_ctx(KnowledgeBase *kb, const char *name);
+int knowledge_attach_ctx(KnowledgeBase *kb, const char *name);
+int knowledge_snapshot_ctx(KnowledgeBase *kb, const char *name);
+int knowledge_rollback_ctx(KnowledgeBase *kb, const char *name);
+int knowledge_drop_snapshot_ctx(KnowledgeBase *kb, const char *name);
+int knowledge_search_ctx(KnowledgeBase *kb, const char *intent, const char *query, char *response, int n);
+int knowledge_spot_ctx(KnowledgeBase *kb, const char *intent, const char *text, char *entity, int n);
+int knowledge_similar_ctx(KnowledgeBase *kb, const char *intent, const char *query, char *response, int n);
+void knowledge_set_approximate_ctx(KnowledgeBase *kb, int approximate);
+void knowledge_miss_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char *question);
+int knowledge_top_misses_ctx(KnowledgeBase *kb, MissCount *top, int k);
+void knowledge_save_misses_ctx(KnowledgeBase *kb);
 int knowledge_get(const char *intent, const char *entity, char *response, int n);
+int knowledge_view(const char *intent, const char *entity, const char **response, int *len);
+void knowledge_view_release(const char *response);
+int knowledge_get_many(const KnowledgeKey *keys, int count, char *responses[], int n, int results[]);
 int knowledge_put(const char *intent, const char *entity, const char *response);
 void knowledge_reset();
 int knowledge_read(FILE *f);
 void knowledge_write(FILE *f);
+int knowledge_erase();
+int knowledge_publish(const char *path);
+int knowledge_follow(const char *path, const char *snapshot);
+int knowledge_replicate();
+int knowledge_is_replica();
+int knowledge_share(const char *name);
+int knowledge_attach(const char *name);
+int knowledge_snapshot(const char *name);
+int knowledge_rollback(const char *name);
+int knowledge_drop_snapshot(const char *name);
+int knowledge_search(const char *intent, const char *query, char *response, int n);
+int knowledge_spot(const char *intent, const char *text, char *entity, int n);
+int knowledge_similar(const char *intent, const char *query, char *response, int n);
+void knowledge_set_approximate(int approximate);
+void knowledge_miss(const char *intent, const char *entity, const char *question);
+int knowledge_top_misses(MissCount *top, int k);
+void knowledge_save_misses();
+
+/* functions defined in search.c */
+SearchIndex *search_create();
+void search_destroy(SearchIndex *ix);
+void search_clear(SearchIndex *ix);
+int search_add(SearchIndex *ix, const char *intent, const char *entity, const char *response);
+int search_stale(const SearchIndex *ix);
+int search_query(SearchIndex *ix, const char *intent, const char *query, SearchHit *hits, int k);
+
+/* functions defined in spot.c */
+EntitySpotter *spot_create();
+void spot_destroy(EntitySpotter *sp);
+void spot_clear(EntitySpotter *sp);
+int spot_add(EntitySpotter *sp, const char *intent, const char *entity);
+int spot_find(EntitySpotter *sp, const char *intent, const char *text, char *entity, int n);
+
+/* functions defined in vector.c */
+VectorIndex *vector_create(int ivf);
+void vector_set_ivf(VectorIndex *vx, int ivf);
+void vector_destroy(VectorIndex *vx);
+void vector_clear(VectorIndex *vx);
+int vector_add(VectorIndex *vx, const char *intent, const char *entity, const char *response);
+int vector_query(VectorIndex *vx, const char *intent, const char *query, SearchHit *hit);
+int vector_names(const char *query, const char *entity);
+
+/* functions defined in misses.c */
+MissTracker *misses_create();
+void misses_destroy(MissTracker *mt);
+void misses_clear(MissTracker *mt);
+void misses_add(MissTracker *mt, const char *intent, const char *entity, const char *question);
+void misses_remove(MissTracker *mt, const char *intent, const char *entity);
+int misses_top(const MissTracker *mt, MissCount *top, int k);
+
+/* functions defined in shared.c */
+SharedKnowledge *shared_publish(const char *name);
+SharedKnowledge *shared_attach(const char *name);
+void shared_close(SharedKnowledge *sh);
+int shared_begin(SharedKnowledge *sh, int count, size_t bytes);
+int shared_commit(SharedKnowledge *sh);
+int shared_put(SharedKnowledge *sh, const char *intent, const char *entity, const char *response);
+int shared_get(SharedKnowledge *sh, const char *intent, const char *entity, char *response, int n);
+
+/* functions defined in transcript.c */
+TranscriptLog *transcript_open(const char *path, int policy, long rotate);
+void transcript_close(TranscriptLog *tl);
+int transcript_log(TranscriptLog *tl, const char *speaker, const char *text);
+unsigned long transcript_dropped(const TranscriptLog *tl);
+
+/* functions defined in sidecar.c */
+Sidecar *sidecar_open(const char *path);
+Sidecar *sidecar_dup(Sidecar *sc);
+void sidecar_close(Sidecar *sc);
+int sidecar_find(Sidecar *sc, const char *intent, const char *entity, void (*insert)(void *, const char *, const char *, const char *), void *arg);
+int sidecar_read_section(Sidecar *sc, const char *intent, void (*insert)(void *, const char *, const char *, const char *), void *arg);
 
 #endif
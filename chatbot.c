@@ -54,16 +54,44 @@
  * You can rename the chatbot and the user by changing chatbot_botname() and
  * chatbot_username(), respectively. The main loop will print the strings
  * returned by these functions at the start of each line.
+ *
+ * chatbot_main() talks to the process-wide knowledge base. A program that
+ * embeds several independent chatbots, for example one per worker thread,
+ * makes each with chatbot_create() and drives it with chatbot_main_ctx();
+ * chatbots made this way share no state with each other.
  */
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef _WIN32
+#define strtok_r strtok_s
+#endif
 #include "chat1503C.h"
 
-static char last_intent[MAX_INTENT] = "";
-static char last_entity[MAX_ENTITY] = "";
+/* one chatbot made with chatbot_create() */
+struct ChatbotContext {
+	KnowledgeBase *kb;
+	ChatbotSession session;
+};
+
+/* word delimiters */
+const char *delimiters = " ?\t\n";
+
+/* the conversation driven through chatbot_main() */
+static ChatbotSession default_session = { SESSION_IDLE, "", "" };
+
+static int chatbot_session_main_kb(KnowledgeBase *kb, ChatbotSession *session, int inc, char *inv[], char *response, int n);
+static int chatbot_session_question_kb(KnowledgeBase *kb, ChatbotSession *session, int inc, char *inv[], char *response, int n);
+static int chatbot_do_load_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_reset_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_save_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_snapshot_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_rollback_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_drop_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
+static int chatbot_do_top_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n);
 
 /*
  * Get the name of the chatbot.
@@ -101,6 +129,152 @@ const char *chatbot_username() {
  */
 int chatbot_main(int inc, char *inv[], char *response, int n) {
 
+	return chatbot_session_main(&default_session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Create a chatbot with a knowledge base of its own, independent of every
+ * other chatbot in the process.
+ *
+ * Input:
+ *   path - the knowledge base's default file
+ *
+ * Returns: the chatbot, or NULL if it could not be created
+ */
+ChatbotContext *chatbot_create(const char *path) {
+
+	ChatbotContext *ctx = (ChatbotContext *)malloc(sizeof(ChatbotContext));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->kb = knowledge_create(path);
+	if (ctx->kb == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	chatbot_session_init(&ctx->session);
+
+	return ctx;
+
+}
+
+
+/*
+ * Free a chatbot made with chatbot_create(). Its default file is left as
+ * it is.
+ */
+void chatbot_destroy(ChatbotContext *ctx) {
+
+	if (ctx == NULL)
+		return;
+
+	knowledge_destroy(ctx->kb);
+	free(ctx);
+
+}
+
+
+/*
+ * Get a chatbot's knowledge base, for use with the knowledge_*_ctx()
+ * functions.
+ */
+KnowledgeBase *chatbot_knowledge(ChatbotContext *ctx) {
+
+	return ctx->kb;
+
+}
+
+
+/*
+ * Get a response to user input from a chatbot made with chatbot_create().
+ *
+ * Returns:
+ *   as chatbot_main()
+ */
+int chatbot_main_ctx(ChatbotContext *ctx, int inc, char *inv[], char *response, int n) {
+
+	return chatbot_session_main_kb(ctx->kb, &ctx->session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Give a chatbot made with chatbot_create() its next line of input, as
+ * chatbot_session_step().
+ */
+int chatbot_step_ctx(ChatbotContext *ctx, char *line, char *response, int n) {
+
+	char *inv[MAX_INPUT];
+	int inc = split_words(line, inv, MAX_INPUT);
+
+	return chatbot_main_ctx(ctx, inc, inv, response, n);
+
+}
+
+
+/*
+ * Start a new conversation.
+ *
+ * Input:
+ *   session - the conversation's state
+ */
+void chatbot_session_init(ChatbotSession *session) {
+
+	session->state = SESSION_IDLE;
+	session->intent[0] = '\0';
+	session->entity[0] = '\0';
+
+}
+
+
+/*
+ * Resume a conversation with its next line of input. This never waits for
+ * input itself: the whole state of the conversation between lines is held
+ * in the session, so a server can keep any number of conversations open and
+ * step whichever one has a line ready.
+ *
+ * Input:
+ *   session  - the conversation's state
+ *   line     - the line of input (it is split into words in place)
+ *   response - a buffer to receive the response
+ *   n        - the size of the response buffer
+ *
+ * Returns:
+ *   as chatbot_main(); an empty line gets an empty response
+ */
+int chatbot_session_step(ChatbotSession *session, char *line, char *response, int n) {
+
+	char *inv[MAX_INPUT];
+	int inc = split_words(line, inv, MAX_INPUT);
+
+	return chatbot_session_main(session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Get a response to user input within a given conversation.
+ *
+ * See the comment at the top of the file for a description of how this
+ * function is used.
+ *
+ * Returns:
+ *   as chatbot_main()
+ */
+int chatbot_session_main(ChatbotSession *session, int inc, char *inv[], char *response, int n) {
+
+    return chatbot_session_main_kb(NULL, session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Get a response from a given knowledge base, as chatbot_session_main().
+ */
+static int chatbot_session_main_kb(KnowledgeBase *kb, ChatbotSession *session, int inc, char *inv[], char *response, int n) {
+
 	/* check for empty input */
 	if (inc < 1) {
 		snprintf(response, n, "");
@@ -111,13 +285,21 @@ int chatbot_main(int inc, char *inv[], char *response, int n) {
 	if (chatbot_is_exit(inv[0]))
 		return chatbot_do_exit(inc, inv, response, n);
 	else if (chatbot_is_load(inv[0]))
-		return chatbot_do_load(inc, inv, response, n);
+		return chatbot_do_load_kb(kb, inc, inv, response, n);
+	else if (chatbot_is_snapshot(inv[0]))
+		return chatbot_do_snapshot_kb(kb, inc, inv, response, n);
+	else if (chatbot_is_rollback(inv[0]))
+		return chatbot_do_rollback_kb(kb, inc, inv, response, n);
+	else if (chatbot_is_drop(inv[0]))
+		return chatbot_do_drop_kb(kb, inc, inv, response, n);
+	else if (chatbot_is_top(inv[0]))
+		return chatbot_do_top_kb(kb, inc, inv, response, n);
 	else if (chatbot_is_question(inv[0]))
-		return chatbot_do_question(inc, inv, response, n);
+		return chatbot_session_question_kb(kb, session, inc, inv, response, n);
 	else if (chatbot_is_reset(inv[0]))
-		return chatbot_do_reset(inc, inv, response, n);
+		return chatbot_do_reset_kb(kb, inc, inv, response, n);
 	else if (chatbot_is_save(inv[0]))
-		return chatbot_do_save(inc, inv, response, n);
+		return chatbot_do_save_kb(kb, inc, inv, response, n);
 	else {
 		snprintf(response, n, "I don't understand \"%s\".", inv[0]);
 		return 0;
@@ -188,12 +370,28 @@ int chatbot_is_load(const char *intent) {
  *   0 (the chatbot always continues chatting after loading knowledge)
  */
 int chatbot_do_load(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_load_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Load a file into a given knowledge base, as chatbot_do_load().
+ */
+static int chatbot_do_load_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
 // Ensure there's a file name provided
     if (inc < 2) {
         snprintf(response, n, "Please specify the file to load from.");
         return 0;
     }
 
+    // A replica's knowledge is owned by its leader
+    if (knowledge_is_replica_ctx(kb)) {
+        snprintf(response, n, "I am a read-only replica and cannot load files.");
+        return 0;
+    }
+
     // Open the file specified in the second word of user input
     const char *filename = inv[1];
     FILE *file = fopen(filename, "r");
@@ -203,7 +401,7 @@ int chatbot_do_load(int inc, char *inv[], char *response, int n) {
     }
 
     // Use knowledge_read() to read from file
-    int pairs_read = knowledge_read(file);
+    int pairs_read = knowledge_read_ctx(kb, file);
     fclose(file);
 
     if (pairs_read < 0) {
@@ -269,6 +467,30 @@ int chatbot_is_question(const char *intent) {
  */
 
 int chatbot_do_question(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_session_question(&default_session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Answer a question, or learn the answer to the question the chatbot could
+ * not answer on the previous line, within a given conversation.
+ *
+ * Returns:
+ *   as chatbot_do_question()
+ */
+int chatbot_session_question(ChatbotSession *session, int inc, char *inv[], char *response, int n) {
+
+    return chatbot_session_question_kb(NULL, session, inc, inv, response, n);
+
+}
+
+
+/*
+ * Answer a question from a given knowledge base, as chatbot_session_question().
+ */
+static int chatbot_session_question_kb(KnowledgeBase *kb, ChatbotSession *session, int inc, char *inv[], char *response, int n) {
     if (inc < 1 || inv == NULL || response == NULL || n <= 0) {
         snprintf(response, n, "Invalid input.");
         return 0;
@@ -276,13 +498,13 @@ int chatbot_do_question(int inc, char *inv[], char *response, int n) {
 
     // First, check user's input for specific commands (RESET, LOAD, SAVE, EXIT)
     if (chatbot_is_reset(inv[0])) {
-        return chatbot_do_reset(inc, inv, response, n);
+        return chatbot_do_reset_kb(kb, inc, inv, response, n);
     }
     if (chatbot_is_load(inv[0])) {
-        return chatbot_do_load(inc, inv, response, n);
+        return chatbot_do_load_kb(kb, inc, inv, response, n);
     }
     if (chatbot_is_save(inv[0])) {
-        return chatbot_do_save(inc, inv, response, n);
+        return chatbot_do_save_kb(kb, inc, inv, response, n);
     }
     if (chatbot_is_exit(inv[0])) {
         return chatbot_do_exit(inc, inv, response, n);
@@ -304,8 +526,7 @@ int chatbot_do_question(int inc, char *inv[], char *response, int n) {
     // If it's a new question, process it
     if (is_question) {
         // Clear any previous question state
-        last_intent[0] = '\0';
-        last_entity[0] = '\0';
+        chatbot_session_init(session);
 
         if (inc < 2) {
             snprintf(response, n, "Please ask a complete question.");
@@ -332,31 +553,52 @@ int chatbot_do_question(int inc, char *inv[], char *response, int n) {
             strcat(entity, inv[i]);
         }
 
-        // Try to get the answer
-        int result = knowledge_get(first_word, entity, response, n);
-
+        // Try to get the answer, then look for a known entity mentioned
+        // in the question, then fall back to searching the responses
+        int result = knowledge_get_ctx(kb, first_word, entity, response, n);
+        if (result == KB_NOTFOUND) {
+            char spotted[MAX_ENTITY];
+            if (knowledge_spot_ctx(kb, first_word, entity, spotted, MAX_ENTITY) == KB_OK) {
+                result = knowledge_get_ctx(kb, first_word, spotted, response, n);
+            }
+        }
+        if (result == KB_NOTFOUND) {
+            result = knowledge_search_ctx(kb, first_word, entity, response, n);
+        }
         if (result == KB_NOTFOUND) {
-            // Store current question for learning
-            strncpy(last_intent, first_word, MAX_INTENT - 1);
-            last_intent[MAX_INTENT - 1] = '\0';
-            strncpy(last_entity, entity, MAX_ENTITY - 1);
-            last_entity[MAX_ENTITY - 1] = '\0';
+            result = knowledge_similar_ctx(kb, first_word, entity, response, n);
+        }
 
-            // "I don't know" response
-            snprintf(response, n, "I don't know. ");
+        if (result == KB_BUSY) {
+            // Not known either way, so neither counted as a miss nor learned
+            snprintf(response, n, "My knowledge is being updated. Please ask again.");
+            return 0;
+        }
+        if (result == KB_NOTFOUND) {
+            // The question as asked, keeping the "is" or "are"
+            char question[MAX_INPUT];
             if (entity_start == 2) {
-                snprintf(response + strlen(response), n - strlen(response), 
-                        "%s %s %s?", inv[0], inv[1], entity);
+                snprintf(question, sizeof(question), "%s %s %s", inv[0], inv[1], entity);
             } else {
-                snprintf(response + strlen(response), n - strlen(response), 
-                        "%s %s?", inv[0], entity);
+                snprintf(question, sizeof(question), "%s %s", inv[0], entity);
             }
+            knowledge_miss_ctx(kb, first_word, entity, question);
+
+            // Wait for the user to teach us the answer
+            strncpy(session->intent, first_word, MAX_INTENT - 1);
+            session->intent[MAX_INTENT - 1] = '\0';
+            strncpy(session->entity, entity, MAX_ENTITY - 1);
+            session->entity[MAX_ENTITY - 1] = '\0';
+            session->state = SESSION_AWAITING_ANSWER;
+
+            // "I don't know" response
+            snprintf(response, n, "I don't know. %s?", question);
         }
         return 0;
     }
     
     // If we have a pending question and this is not a question, treat it as an answer
-    else if (strlen(last_intent) > 0 && strlen(last_entity) > 0) {
+    else if (session->state == SESSION_AWAITING_ANSWER) {
         // Build the answer string
         char answer[MAX_RESPONSE] = "";
         for (int i = 0; i < inc; i++) {
@@ -365,13 +607,12 @@ int chatbot_do_question(int inc, char *inv[], char *response, int n) {
         }
         
         // Store the new knowledge
-        int result = knowledge_put(last_intent, last_entity, answer);
+        int result = knowledge_put_ctx(kb, session->intent, session->entity, answer);
         if (result == KB_OK) {
             snprintf(response, n, "Thank you.");
             
             // Clear the last question state
-            last_intent[0] = '\0';
-            last_entity[0] = '\0';
+            chatbot_session_init(session);
         } else {
             snprintf(response, n, "I couldn't store that information.");
         }
@@ -411,16 +652,25 @@ int chatbot_is_reset(const char *intent) {
  *
  */
 int chatbot_do_reset(int inc, char *inv[], char *response, int n) {
-    // Clear the in-memory knowledge base
-    knowledge_reset();
-    
-    // Clear the file content but keep the structure
-    FILE* f = fopen("ICT1503C_Project_Sample.ini", "w");
-    if (f != NULL) {
-        // Write the section headers
-        fprintf(f, "[what]\n\n[where]\n\n[who]\n");
-        fclose(f);
+
+    return chatbot_do_reset_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Reset a given knowledge base, as chatbot_do_reset().
+ */
+static int chatbot_do_reset_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
+    // A replica's knowledge is owned by its leader
+    if (knowledge_is_replica_ctx(kb)) {
+        snprintf(response, n, "I am a read-only replica and cannot be reset.");
+        return 0;
     }
+
+    // Clear the in-memory knowledge base and the file content, but keep
+    // the file's structure
+    knowledge_erase_ctx(kb);
     
     snprintf(response, n, "Chatbot reset.");
     return 0;
@@ -454,6 +704,16 @@ int chatbot_is_save(const char *intent) {
  *   0 (the chatbot always continues chatting after saving knowledge)
  */
 int chatbot_do_save(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_save_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Save a given knowledge base, as chatbot_do_save().
+ */
+static int chatbot_do_save_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
     // Check if filename is provided
     if (inc < 2) {
         snprintf(response, n, "Please specify a file to save to.");
@@ -476,7 +736,7 @@ int chatbot_do_save(int inc, char *inv[], char *response, int n) {
         return 0;
     }
 
-    knowledge_write(fp);
+    knowledge_write_ctx(kb, fp);
     fclose(fp);
     
     snprintf(response, n, "My knowledge has been saved to %s.", inv[filename_index]);
@@ -484,4 +744,310 @@ int chatbot_do_save(int inc, char *inv[], char *response, int n) {
 }
 
 
+/*
+ * Determine whether an intent is SNAPSHOT.
+ *
+ * Input:
+ *  intent - the intent
+ *
+ * Returns:
+ *  1, if the intent is "snapshot"
+ *  0, otherwise
+ */
+int chatbot_is_snapshot(const char *intent) {
+
+	return compare_token(intent, "snapshot") == 0;
+
+}
+
+
+/*
+ * Remember the chatbot's current knowledge under a name, so that it can be
+ * rolled back to later.
+ *
+ * See the comment at the top of the file for a description of how this
+ * function is used.
+ *
+ * Returns:
+ *   0 (the chatbot always continues chatting after taking a snapshot)
+ */
+int chatbot_do_snapshot(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_snapshot_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Take a snapshot of a given knowledge base, as chatbot_do_snapshot().
+ */
+static int chatbot_do_snapshot_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
+    if (inc < 2) {
+        snprintf(response, n, "Please name the snapshot.");
+        return 0;
+    }
+
+    int result = knowledge_snapshot_ctx(kb, inv[1]);
+    if (result == KB_OK) {
+        snprintf(response, n, "Snapshot \"%s\" taken.", inv[1]);
+    } else {
+        snprintf(response, n, "I couldn't take snapshot \"%s\".", inv[1]);
+    }
+    return 0;
+}
+
+
+/*
+ * Determine whether an intent is ROLLBACK.
+ *
+ * Input:
+ *  intent - the intent
+ *
+ * Returns:
+ *  1, if the intent is "rollback"
+ *  0, otherwise
+ */
+int chatbot_is_rollback(const char *intent) {
+
+	return compare_token(intent, "rollback") == 0;
+
+}
+
+
+/*
+ * Return the chatbot's knowledge to a named snapshot.
+ *
+ * inv[1] may contain "to"; if so, it is skipped.
+ *
+ * See the comment at the top of the file for a description of how this
+ * function is used.
+ *
+ * Returns:
+ *   0 (the chatbot always continues chatting after rolling back)
+ */
+int chatbot_do_rollback(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_rollback_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Roll a given knowledge base back, as chatbot_do_rollback().
+ */
+static int chatbot_do_rollback_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
+    int name_index = 1;
+    if (inc > 2 && compare_token(inv[1], "to") == 0) {
+        name_index = 2;
+    }
+
+    if (name_index >= inc) {
+        snprintf(response, n, "Please name the snapshot to roll back to.");
+        return 0;
+    }
+
+    int result = knowledge_rollback_ctx(kb, inv[name_index]);
+    if (result == KB_OK) {
+        snprintf(response, n, "Rolled back to snapshot \"%s\".", inv[name_index]);
+    } else if (result == KB_NOTFOUND) {
+        snprintf(response, n, "I don't have a snapshot called \"%s\".", inv[name_index]);
+    } else {
+        snprintf(response, n, "I couldn't roll back to snapshot \"%s\".", inv[name_index]);
+    }
+    return 0;
+}
+
+
+/*
+ * Determine whether an intent is DROP.
+ *
+ * Input:
+ *  intent - the intent
+ *
+ * Returns:
+ *  1, if the intent is "drop"
+ *  0, otherwise
+ */
+int chatbot_is_drop(const char *intent) {
+
+	return compare_token(intent, "drop") == 0;
+
+}
+
+
+/*
+ * Forget a named snapshot, so that what only it remembered can be freed.
+ *
+ * inv[1] may contain "snapshot"; if so, it is skipped.
+ *
+ * See the comment at the top of the file for a description of how this
+ * function is used.
+ *
+ * Returns:
+ *   0 (the chatbot always continues chatting after dropping a snapshot)
+ */
+int chatbot_do_drop(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_drop_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * Drop a snapshot of a given knowledge base, as chatbot_do_drop().
+ */
+static int chatbot_do_drop_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
+    int name_index = 1;
+    if (inc > 2 && compare_token(inv[1], "snapshot") == 0) {
+        name_index = 2;
+    }
+
+    if (name_index >= inc) {
+        snprintf(response, n, "Please name the snapshot to drop.");
+        return 0;
+    }
+
+    int result = knowledge_drop_snapshot_ctx(kb, inv[name_index]);
+    if (result == KB_OK) {
+        snprintf(response, n, "Dropped snapshot \"%s\".", inv[name_index]);
+    } else {
+        snprintf(response, n, "I don't have a snapshot called \"%s\".", inv[name_index]);
+    }
+    return 0;
+}
+
+
+/*
+ * Determine whether an intent is TOP.
+ *
+ * Input:
+ *  intent - the intent
+ *
+ * Returns:
+ *  1, if the intent is "top"
+ *  0, otherwise
+ */
+int chatbot_is_top(const char *intent) {
+
+	return compare_token(intent, "top") == 0;
+
+}
+
+
+/*
+ * List the questions the chatbot has most often been unable to answer.
+ *
+ * inv[1] may contain "misses"; if so, it is skipped. The next word, if any,
+ * is the number of questions to list.
+ *
+ * See the comment at the top of the file for a description of how this
+ * function is used.
+ *
+ * Returns:
+ *   0 (the chatbot always continues chatting after listing)
+ */
+int chatbot_do_top(int inc, char *inv[], char *response, int n) {
+
+    return chatbot_do_top_kb(NULL, inc, inv, response, n);
+
+}
+
+
+/*
+ * List a given knowledge base's unanswered questions, as chatbot_do_top().
+ */
+static int chatbot_do_top_kb(KnowledgeBase *kb, int inc, char *inv[], char *response, int n) {
+    int count_index = 1;
+    if (inc > 1 && compare_token(inv[1], "misses") == 0) {
+        count_index = 2;
+    }
+
+    int k = 5;
+    if (count_index < inc) {
+        k = atoi(inv[count_index]);
+        if (k < 1 || k > 20) {
+            snprintf(response, n, "Please ask for between 1 and 20 questions.");
+            return 0;
+        }
+    }
+
+    MissCount top[20];
+    int count = knowledge_top_misses_ctx(kb, top, k);
+    if (count == 0) {
+        snprintf(response, n, "I have answered every question so far.");
+        return 0;
+    }
+
+    // List as many as fit in the response
+    int len = snprintf(response, n, "I was most often unable to answer:");
+    for (int i = 0; i < count && len < n; i++) {
+        len += snprintf(response + len, n - len, "%s %s? (%lu)", i == 0 ? "" : ";",
+                        top[i].question, top[i].count);
+    }
+    return 0;
+}
+
+
+/*
+ * Utility function for comparing string case-insensitively.
+ *
+ * Input:
+ *   token1 - the first token
+ *   token2 - the second token
+ *
+ * Returns:
+ *   as strcmp()
+ */
+int compare_token(const char *token1, const char *token2) {
+
+	int i = 0;
+	while (token1[i] != '\0' && token2[i] != '\0') {
+		if (toupper(token1[i]) < toupper(token2[i]))
+			return -1;
+		else if (toupper(token1[i]) > toupper(token2[i]))
+			return 1;
+		i++;
+	}
+
+	if (token1[i] == '\0' && token2[i] == '\0')
+		return 0;
+	else if (token1[i] == '\0')
+		return -1;
+	else
+		return 1;
+
+}
+
+
+/*
+ * Split a line of input into words, removing trailing punctuation from each.
+ *
+ * Input:
+ *   input - the line; it is modified in place
+ *   inv   - receives pointers to the beginning of each word, followed by NULL
+ *   max   - the number of elements in inv
+ *
+ * Returns: the number of words
+ */
+int split_words(char *input, char *inv[], int max) {
+
+	char *save;
+	int inc = 0;
+	char *word = strtok_r(input, delimiters, &save);
+	while (word != NULL && inc < max - 1) {
+
+		/* remove trailing punctuation */
+		int len = strlen(word);
+		while (len > 0 && ispunct(word[len - 1])) {
+			word[len - 1] = '\0';
+			len--;
+		}
+
+		/* go to the next word */
+		inv[inc++] = word;
+		word = strtok_r(NULL, delimiters, &save);
+	}
+	inv[inc] = NULL;
 
+	return inc;
+}
@@ -25,24 +25,120 @@
  * knowledge_reset() erases all of the knowledge.
  * knowledge_write() saves the knowledge base in a file.
  *
+ * These work on one process-wide knowledge base kept in the default file. A
+ * program that needs more than one, say one per worker thread, creates them
+ * with knowledge_create() and passes them to the knowledge_*_ctx() versions
+ * of the same functions; a NULL knowledge base there means the default one.
+ *
  * You may add helper functions as necessary.
  */
 
 
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifndef KB_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "chat1503C.h"
 
 #define FILE_NAME "ICT1503C_Project_Sample.ini"
 
+/* number of shards the knowledge base is partitioned into (must be a power of two) */
+#define KB_SHARDS                 64
+
+
+/* the most distinct intents (section names) the knowledge base can hold */
+#define KB_MAX_INTENTS            256
+
+/* initial number of slots in a shard's table (must be a power of two) */
+#define KB_SHARD_INITIAL          8
 
-typedef struct KnowledgeNode {
+/* the delta file is folded into the default file once it holds this many
+   changes and more than half as many as the knowledge base has entries */
+#define KB_DELTA_MIN              1024
+
+
+// The cold part of an entry: its text, only read once a lookup has matched
+// the entry's hot slot
+typedef struct KnowledgeEntry {
+    int refs;                       // shard tables, views and the dirty list holding the entry (atomic: views may be released from any thread)
+    unsigned long seq;              // the change that made the entry, 0 if it was loaded
+    int from_default;               // read lazily from the default file, so a later line of it may replace it
     char intent[MAX_INTENT];
     char entity[MAX_ENTITY];
     char response[MAX_RESPONSE];
-    struct KnowledgeNode* next;
-} KnowledgeNode;
+} KnowledgeEntry;
+
+// The hot part of an entry: everything a lookup compares before it touches
+// the entry itself. An empty slot has no entry.
+typedef struct KnowledgeSlot {
+    unsigned int hash;              // knowledge_hash() of the entity
+    unsigned short intent;          // index into kb->intents
+    unsigned short entity_len;
+    KnowledgeEntry* entry;
+} KnowledgeSlot;
+
+// One shard: an open-addressed table of slots, probed linearly. Tables are
+// shared between versions of the knowledge base and copied before a shared
+// one is modified.
+typedef struct KnowledgeShard {
+    int refs;                       // the live knowledge base and snapshots holding the table
+    int count;
+    int capacity;
+    KnowledgeSlot slots[1];         // 'capacity' slots
+} KnowledgeShard;
+
+// A named version of the knowledge base. Shard tables and entries are never
+// modified once they are shared, so a snapshot only holds on to each shard,
+// and to its own handle on the part of the default file not read yet.
+typedef struct KnowledgeSnapshot {
+    char name[MAX_ENTITY];
+    KnowledgeShard* shards[KB_SHARDS];
+    Sidecar* lazy;
+    unsigned long file_version;     // kb->file_version when it was taken
+    struct KnowledgeSnapshot* next;
+} KnowledgeSnapshot;
+
+// A position in a walk over every entry with knowledge_next()
+typedef struct KnowledgeCursor {
+    int shard;
+    int slot;
+} KnowledgeCursor;
+
+// One entry found by the parallel loader, pointing into the file's text
+typedef struct LoadEntry {
+    const char* intent;             // NULL if the entry comes before its chunk's first section header
+    int intent_len;
+    const char* entity;
+    int entity_len;
+    const char* response;
+    int response_len;
+    unsigned long hash;             // of the entity, as knowledge_hash()
+} LoadEntry;
+
+// The part of a file one loader thread parses
+typedef struct LoadChunk {
+    const char* file;               // the whole file
+    const char* file_end;
+    const char* start;              // the lines this chunk parses
+    const char* end;
+    LoadEntry* entries;
+    int count;
+    int capacity;
+    int failed;                     // set if the chunk could not be parsed
+
+    // The section the chunk leaves open, for the entries of the next chunk
+    // that come before its own first header
+    int seen_header;
+    const char* last_intent;        // NULL if the last header was malformed
+    int last_intent_len;
+} LoadChunk;
 
 typedef struct WrittenIntent {
     char intent[MAX_INTENT];
@@ -51,335 +147,2771 @@ typedef struct WrittenIntent {
 
 
 #define MAX_KNOWLEDGE_BASE_SIZE   64
-static KnowledgeNode* knowledge_base = NULL;  // Head of the linked list
 
-/* Author : Hafiz
- * Get the response to a question.
+/* the maximum number of characters in the path of a default file (including the terminating null) */
+#define KB_MAX_PATH               260
+
+// Everything one chatbot knows. Knowledge bases share nothing, so separate
+// ones can be used from separate threads without locking.
+struct KnowledgeBase {
+    // The default file, loaded on first use, and the delta file that every
+    // change is appended to until the two are folded together
+    char path[KB_MAX_PATH];
+    char delta_path[KB_MAX_PATH + 6];
+    long delta_count;               // the changes in the delta file
+    unsigned long file_version;     // changed whenever the files stop being just a delta away from memory
+
+    // Changes not yet appended to the delta file, oldest first
+    KnowledgeEntry** dirty;
+    int dirty_count;
+    int dirty_capacity;
+    unsigned long change_seq;       // the number of the last change
+
+    // Each shard holds every entry whose case-folded entity hashes to it
+    KnowledgeShard* shards[KB_SHARDS];
+
+    // The names of the intents; slots refer to them by index
+    char intents[KB_MAX_INTENTS][MAX_INTENT];
+    int intent_count;
+
+    // Named snapshots taken with knowledge_snapshot()
+    KnowledgeSnapshot* snapshots;
+
+    // Set when the indexes below no longer match the live entries and must
+    // be rebuilt before they are next used
+    int indexes_stale;
+
+    // Full-text index over the live entries, used by knowledge_search()
+    SearchIndex* index;
+
+    // Automaton over the live entities, used by knowledge_spot()
+    EntitySpotter* spotter;
+
+    // Embeddings of the live entries, used by knowledge_similar(); only
+    // built once it is first called
+    VectorIndex* vectors;
+
+    // 1 to search large intents in vectors through inverted lists, set by
+    // knowledge_set_approximate()
+    int vectors_ivf;
+
+    // The questions that could not be answered, when they were last dumped
+    // to "path.misses", and whether they have changed since
+    MissTracker* misses;
+    time_t misses_dumped;
+    int misses_changed;
+
+    // The default file while it is only partly loaded; entries are read from
+    // it as they are asked for, and all at once before anything needs the whole
+    Sidecar* lazy;
+
+    // Replication: a leader appends every mutation to replication_log; a
+    // follower tails the same file from replication_offset instead. While
+    // replication_batch is set, records are written without flushing each.
+    FILE* replication_log;
+    int replication_batch;
+    int replication_follower;
+    long replication_offset;
+
+    // Shared memory: a publisher mirrors every entry into 'shared'; a reader
+    // answers from it instead of holding any entries itself
+    SharedKnowledge* shared;
+    int shared_reader;
+};
+
+// The knowledge base used by the functions without a KnowledgeBase argument
+static KnowledgeBase knowledge_default = { .path = FILE_NAME, .delta_path = FILE_NAME ".delta" };
+
+/* the maximum number of characters in one record of the replication log
+   (every character of a field may be escaped to two) */
+#define MAX_LOG_RECORD (2 * (MAX_INTENT + MAX_ENTITY + MAX_RESPONSE) + 8)
+
+/* the maximum number of characters in one line of a knowledge or delta file */
+#define MAX_FILE_LINE  (MAX_ENTITY + MAX_RESPONSE + 2)
+
+/* the least similarity, from 0 to 1, of an entry knowledge_similar() answers
+   with, and the less it asks of an entry whose entity the question names in part */
+#define KB_SIMILAR_THRESHOLD      0.4
+#define KB_SIMILAR_NAMED          0.25
+
+/* the least number of seconds between dumps of the unanswered questions */
+#define KB_MISS_DUMP_INTERVAL     60
+
+/* the number of unanswered questions dumped */
+#define KB_MISS_DUMP_COUNT        20
+
+/* the most threads knowledge_read() parses a file with, and the least each one gets */
+#define KB_LOAD_THREADS           16
+#define KB_LOAD_CHUNK             (1L << 20)
+
+/* number of lookups knowledge_get_many() hashes and prefetches together */
+#define KB_PREFETCH_GROUP         8
+
+/* the number of times a shared-memory reader retries a lookup that failed
+   with KB_BUSY, and the nanoseconds it waits before each */
+#define KB_SHARED_WAIT            1000
+#define KB_SHARED_PAUSE           1000000L
+
+#if defined(__GNUC__)
+#define KB_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define KB_PREFETCH(p) ((void)(p))
+#endif
+
+static int knowledge_is_empty(KnowledgeBase *kb);
+static unsigned long knowledge_hash(const char *entity);
+static unsigned long knowledge_hash_bytes(const char *entity, int len);
+static int knowledge_insert_hashed(KnowledgeBase *kb, unsigned long hash, const char *intent, const char *entity, const char *response);
+static int knowledge_insert(KnowledgeBase *kb, const char *intent, const char *entity, const char *response);
+static void knowledge_load_default(KnowledgeBase *kb);
+static void knowledge_load_delta(KnowledgeBase *kb);
+static void knowledge_prepare(KnowledgeBase *kb);
+static KnowledgeEntry* knowledge_lookup(KnowledgeBase *kb, const char *intent, const char *entity);
+static int knowledge_shared_get(KnowledgeBase *kb, const char *intent, const char *entity, char *response, int n);
+static void knowledge_materialize(KnowledgeBase *kb, const char *intent);
+static void knowledge_discard_lazy(KnowledgeBase *kb);
+static KnowledgeEntry* knowledge_find(KnowledgeBase *kb, unsigned long hash, const char *intent, const char *entity);
+static void knowledge_log_record(KnowledgeBase *kb, const char *format, ...);
+static void knowledge_log_put(KnowledgeBase *kb, const char *intent, const char *entity, const char *response);
+static void knowledge_escape(char *out, const char *in, int n);
+static void knowledge_unescape(char *s);
+static int knowledge_save_default(KnowledgeBase *kb);
+static int knowledge_save_changes(KnowledgeBase *kb);
+static int knowledge_mark_dirty(KnowledgeBase *kb, const char *intent, const char *entity);
+static void knowledge_clear_dirty(KnowledgeBase *kb);
+static void knowledge_punctuate(char *out, const char *response, int len);
+static int knowledge_valid_intent(const char *intent, int len);
+static int knowledge_restore(KnowledgeBase *kb, KnowledgeSnapshot *snapshot);
+static int knowledge_save_rollback(KnowledgeBase *kb, KnowledgeSnapshot *snapshot);
+static void knowledge_free_snapshot(KnowledgeSnapshot *snapshot);
+static int knowledge_replace_file(const char *temp, const char *path);
+static void knowledge_forget(KnowledgeBase *kb, const char *intent, const char *entity);
+static void knowledge_refresh_indexes(KnowledgeBase *kb);
+static KnowledgeSnapshot* knowledge_find_snapshot(KnowledgeBase *kb, const char *name);
+static void knowledge_index_entry(KnowledgeBase *kb, const char *intent, const char *entity, const char *response);
+static void knowledge_reindex(KnowledgeBase *kb);
+static int knowledge_share_all(KnowledgeBase *kb);
+
+
+/*
+ * Resolve the knowledge base a knowledge_*_ctx() function was given.
+ *
+ * Returns: kb, or the default knowledge base if kb is NULL
+ */
+static KnowledgeBase* knowledge_base_of(KnowledgeBase *kb) {
+    return kb != NULL ? kb : &knowledge_default;
+}
+
+
+/*
+ * Hash an entity case-insensitively (FNV-1a over the upper-cased characters),
+ * so that entities differing only in case land in the same shard.
  *
  * Input:
- *   intent   - the question word
- *   entity   - the entity
- *   response - a buffer to receive the response
- *   n        - the maximum number of characters to write to the response buffer
+ *   entity - the entity
  *
- * Returns:
- *   KB_OK, if a response was found for the intent and entity (the response is copied to the response buffer)
- *   KB_NOTFOUND, if no response could be found
- *   KB_INVALID, if 'intent' is not a recognised question word
+ * Returns: the hash of the entity
  */
-// Get the response to a question
+static unsigned long knowledge_hash(const char *entity) {
+    return knowledge_hash_bytes(entity, (int)strlen(entity));
+}
 
-int knowledge_get(const char *intent, const char *entity, char *response, int n) {
-    // Validate inputs
-    if (intent == NULL || entity == NULL || response == NULL || n <= 0) {
-        return KB_INVALID;
+
+/*
+ * Hash the first len characters of an entity, as knowledge_hash().
+ */
+static unsigned long knowledge_hash_bytes(const char *entity, int len) {
+    unsigned long hash = 2166136261UL;
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)toupper((unsigned char)entity[i]);
+        hash *= 16777619UL;
     }
+    return hash & 0xFFFFFFFFUL;
+}
 
-    // If knowledge base is empty, try to load from file
-    if (knowledge_base == NULL) {
-        FILE* f = fopen("ICT1503C_Project_Sample.ini", "r");
-        if (f != NULL) {
-            char line[MAX_INPUT];
-            char current_intent[MAX_INTENT] = "";
-
-            while (fgets(line, sizeof(line), f)) {
-                // Remove newline
-                line[strcspn(line, "\n")] = 0;
-                
-                // Skip empty lines
-                if (strlen(line) == 0) continue;
-
-                // Check for section header
-                if (line[0] == '[') {
-                    char* end = strchr(line, ']');
-                    if (end) {
-                        *end = '\0';
-                        strncpy(current_intent, line + 1, MAX_INTENT - 1);
-                        current_intent[MAX_INTENT - 1] = '\0';
-                    }
-                    continue;
-                }
 
-                // Parse entity=response pairs
-                char* separator = strchr(line, '=');
-                if (separator && strlen(current_intent) > 0) {
-                    *separator = '\0';
-                    char* file_entity = line;
-                    char* file_response = separator + 1;
-
-                    // Create new node
-                    KnowledgeNode* new_node = (KnowledgeNode*)malloc(sizeof(KnowledgeNode));
-                    if (new_node != NULL) {
-                        strncpy(new_node->intent, current_intent, MAX_INTENT - 1);
-                        new_node->intent[MAX_INTENT - 1] = '\0';
-                        strncpy(new_node->entity, file_entity, MAX_ENTITY - 1);
-                        new_node->entity[MAX_ENTITY - 1] = '\0';
-                        strncpy(new_node->response, file_response, MAX_RESPONSE - 1);
-                        new_node->response[MAX_RESPONSE - 1] = '\0';
-
-                        new_node->next = knowledge_base;
-                        knowledge_base = new_node;
-                    }
-                }
-            }
-            fclose(f);
+/*
+ * Find the index of an intent's name.
+ *
+ * Input:
+ *   intent - the intent
+ *   add    - 1 to add the intent if it is new, 0 to leave the table alone
+ *
+ * Returns: the index, or -1 if the intent is unknown (or the table is full)
+ */
+static int knowledge_intent_id(KnowledgeBase *kb, const char *intent, int add) {
+    for (int i = 0; i < kb->intent_count; i++) {
+        if (strcasecmp(kb->intents[i], intent) == 0) {
+            return i;
         }
     }
 
-    // Search knowledge base
-    KnowledgeNode* current = knowledge_base;
-    while (current != NULL) {
-        if (strcasecmp(current->intent, intent) == 0 && 
-            strcasecmp(current->entity, entity) == 0) {
-            strncpy(response, current->response, n - 1);
-            response[n - 1] = '\0';
-            return KB_OK;
-        }
-        current = current->next;
+    if (!add || kb->intent_count == KB_MAX_INTENTS) {
+        return -1;
     }
-
-    return KB_NOTFOUND;
+    strncpy(kb->intents[kb->intent_count], intent, MAX_INTENT - 1);
+    kb->intents[kb->intent_count][MAX_INTENT - 1] = '\0';
+    return kb->intent_count++;
 }
 
- 
+
+/*
+ * Determine whether every shard of the knowledge base is empty.
+ */
+static int knowledge_is_empty(KnowledgeBase *kb) {
+    for (int i = 0; i < KB_SHARDS; i++) {
+        if (kb->shards[i] != NULL && kb->shards[i]->count > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 
-/* Author : Harith
- * Insert a new response to a question. If a response already exists for the
- * given intent and entity, it will be overwritten. Otherwise, it will be added
- * to the knowledge base.
+/*
+ * Find the slot of an entry in a shard's table.
  *
  * Input:
- *   intent    - the question word
- *   entity    - the entity
- *   response  - the response for this question and entity
+ *   shard  - the shard
+ *   hash   - knowledge_hash() of the entity
+ *   intent - the index of the question word
+ *   entity - the entity
  *
- * Returns:
- *   KB_FOUND, if successful
- *   KB_NOMEM, if there was a memory allocation failure
- *   KB_INVALID, if the intent is not a valid question word
+ * Returns: the slot holding the entry, or the empty slot where it belongs
  */
-int knowledge_put(const char *intent, const char *entity, const char *response) {
-    // Validate inputs
-    if (intent == NULL || entity == NULL || response == NULL) {
-        return KB_INVALID;
+static KnowledgeSlot* knowledge_probe(KnowledgeShard *shard, unsigned long hash, int intent, const char *entity) {
+    int mask = shard->capacity - 1;
+    int len = (int)strlen(entity);
+    int i = (int)((hash / KB_SHARDS) & mask);
+
+    for (;;) {
+        KnowledgeSlot* slot = &shard->slots[i];
+        if (slot->entry == NULL ||
+            (slot->hash == (unsigned int)hash && slot->intent == intent && slot->entity_len == len &&
+             strcasecmp(slot->entry->entity, entity) == 0)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
     }
+}
 
-    // Validate intent if it is a recognized question word
-    if (strcasecmp(intent, "what") != 0 && 
-        strcasecmp(intent, "where") != 0 && 
-        strcasecmp(intent, "who") != 0) {
-        return KB_INVALID;
+
+/*
+ * Search the knowledge base for an entry.
+ *
+ * Input:
+ *   hash   - knowledge_hash() of the entity
+ *   intent - the question word
+ *   entity - the entity
+ *
+ * Returns: the entry, or NULL if there is none
+ */
+static KnowledgeEntry* knowledge_find(KnowledgeBase *kb, unsigned long hash, const char *intent, const char *entity) {
+    KnowledgeShard* shard = kb->shards[hash & (KB_SHARDS - 1)];
+    int id = knowledge_intent_id(kb, intent, 0);
+    if (shard == NULL || id < 0) {
+        return NULL;
     }
+    return knowledge_probe(shard, hash, id, entity)->entry;
+}
 
-    // Prepare response with period if required
-    char temp_response[MAX_RESPONSE];
-    strncpy(temp_response, response, MAX_RESPONSE - 2);
-    temp_response[MAX_RESPONSE - 2] = '\0';
-    if (strlen(temp_response) > 0 && temp_response[strlen(temp_response) - 1] != '.') {
-        strcat(temp_response, ".");
-    }
-
-    // First update/add to linked list
-    KnowledgeNode* current = knowledge_base;
-    while (current != NULL) {
-        if (strcasecmp(current->intent, intent) == 0 && 
-            strcasecmp(current->entity, entity) == 0) {
-            // Update existing entry
-            strncpy(current->response, temp_response, MAX_RESPONSE - 1);
-            current->response[MAX_RESPONSE - 1] = '\0';
-            break;
+
+/*
+ * Step through every entry of the live knowledge base.
+ *
+ * Input:
+ *   cursor - { 0, -1 } for the first entry, then as left by the previous call
+ *
+ * Returns: the next entry, or NULL after the last one
+ */
+static KnowledgeEntry* knowledge_next(KnowledgeBase *kb, KnowledgeCursor *cursor) {
+    for (; cursor->shard < KB_SHARDS; cursor->shard++, cursor->slot = -1) {
+        KnowledgeShard* shard = kb->shards[cursor->shard];
+        if (shard == NULL) {
+            continue;
+        }
+        while (++cursor->slot < shard->capacity) {
+            if (shard->slots[cursor->slot].entry != NULL) {
+                return shard->slots[cursor->slot].entry;
+            }
         }
-        current = current->next;
     }
+    return NULL;
+}
 
-    // If not found in list, create new node
-    if (current == NULL) {
-        KnowledgeNode* new_node = (KnowledgeNode*)malloc(sizeof(KnowledgeNode));
-        if (new_node == NULL) {
-            return KB_NOMEM;
-        }
 
-        // Initialize new node
-        strncpy(new_node->intent, intent, MAX_INTENT - 1);
-        new_node->intent[MAX_INTENT - 1] = '\0';
-        strncpy(new_node->entity, entity, MAX_ENTITY - 1);
-        new_node->entity[MAX_ENTITY - 1] = '\0';
-        strncpy(new_node->response, temp_response, MAX_RESPONSE - 1);
-        new_node->response[MAX_RESPONSE - 1] = '\0';
+/*
+ * Take a reference to an entry.
+ */
+static void knowledge_retain(KnowledgeEntry *entry) {
+    __atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+}
 
-        // Add to the front of linked list
-        new_node->next = knowledge_base;
-        knowledge_base = new_node;
-    }
 
-    FILE* f = fopen("ICT1503C_Project_Sample.ini", "w");
-    if (f == NULL) {
-        return KB_INVALID;
+/*
+ * Drop a reference to an entry, freeing it once nothing holds it. Views may
+ * be released from any thread, so the count is changed atomically, and the
+ * release orders the holder's last read before the entry is freed or
+ * overwritten.
+ */
+static void knowledge_release(KnowledgeEntry *entry) {
+    if (entry != NULL && __atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(entry);
     }
+}
 
-    // Write sections [what, where, who]
-    const char* sections[] = {"what", "where", "who"};
-    for (int i = 0; i < 3; i++) {
-        int section_started = 0;
-        current = knowledge_base;
-        
-        // Go through all entries for section
-        while (current != NULL) {
-            if (strcasecmp(current->intent, sections[i]) == 0) {
-                if (!section_started) {
-                    fprintf(f, "\n[%s]\n", sections[i]);
-                    section_started = 1;
-                }
-                fprintf(f, "%s=%s\n", current->entity, current->response);
-            }
-            current = current->next;
-        }
-    }
 
-    fclose(f);
-    return KB_OK;
+/*
+ * Drop a reference to a shard's table, freeing it and releasing its entries
+ * once no version of the knowledge base holds it.
+ */
+static void knowledge_release_shard(KnowledgeShard *shard) {
+    if (shard == NULL || --shard->refs > 0) {
+        return;
+    }
+    for (int i = 0; i < shard->capacity; i++) {
+        knowledge_release(shard->slots[i].entry);
+    }
+    free(shard);
 }
 
 
-/* Author : Hafiz
- * Read a knowledge base from a file.
+/*
+ * Allocate an empty shard table holding one reference.
  *
- * Input:
- *   f - the file
+ * Returns: the table, or NULL if there was a memory allocation failure
+ */
+static KnowledgeShard* knowledge_new_shard(int capacity) {
+    KnowledgeShard* shard = (KnowledgeShard*)calloc(1, sizeof(KnowledgeShard) + (capacity - 1) * sizeof(KnowledgeSlot));
+    if (shard == NULL) {
+        return NULL;
+    }
+    shard->refs = 1;
+    shard->capacity = capacity;
+    return shard;
+}
+
+
+/*
+ * Allocate an entry holding one reference.
  *
- * Returns: the number of entity/response pairs successful read from the file
+ * Returns: the entry, or NULL if there was a memory allocation failure
  */
-int knowledge_read(FILE *f) {
-    if (f == NULL) {
-        return 0;
+static KnowledgeEntry* knowledge_new_entry(const char *intent, const char *entity, const char *response) {
+    KnowledgeEntry* entry = (KnowledgeEntry*)malloc(sizeof(KnowledgeEntry));
+    if (entry == NULL) {
+        return NULL;
     }
 
-    char line[MAX_ENTITY + MAX_RESPONSE + 2];
-    char intent[MAX_INTENT];
-    char entity[MAX_ENTITY];
-    char response[MAX_RESPONSE];
-    int count = 0;
-    int in_section = 0;
+    strncpy(entry->intent, intent, MAX_INTENT - 1);
+    entry->intent[MAX_INTENT - 1] = '\0';
+    strncpy(entry->entity, entity, MAX_ENTITY - 1);
+    entry->entity[MAX_ENTITY - 1] = '\0';
+    strncpy(entry->response, response, MAX_RESPONSE - 1);
+    entry->response[MAX_RESPONSE - 1] = '\0';
+    entry->refs = 1;
+    entry->seq = 0;
+    entry->from_default = 0;
+    return entry;
+}
 
-    while (fgets(line, sizeof(line), f) != NULL) {
-        char *newline = strchr(line, '\n');
-        if (newline) {
-            *newline = '\0';
-        }
 
-        if (line[0] == '\0') {
-            continue;
-        }
+/*
+ * Make a shard's table safe to modify: give it one if it has none, copy it
+ * if another version of the knowledge base shares it, and grow it if it is
+ * half full. Copies share the entries with the original.
+ *
+ * Returns: the table, or NULL if there was a memory allocation failure
+ */
+static KnowledgeShard* knowledge_own_shard(KnowledgeBase *kb, int index) {
+    KnowledgeShard* shard = kb->shards[index];
+    if (shard == NULL) {
+        return kb->shards[index] = knowledge_new_shard(KB_SHARD_INITIAL);
+    }
 
-        if (line[0] == '[') {
-            char *end_bracket = strchr(line, ']');
-            if (end_bracket) {
-                *end_bracket = '\0';
-                strncpy(intent, line + 1, MAX_INTENT - 1);
-                intent[MAX_INTENT - 1] = '\0';
-                in_section = 1;
-            } else {
-                in_section = 0;
-            }
-            continue;
-        }
+    int grow = (shard->count + 1) * 2 > shard->capacity;
+    if (shard->refs == 1 && !grow) {
+        return shard;
+    }
 
-        if (in_section) {
-            char *equals_sign = strchr(line, '=');
-            if (equals_sign) {
-                *equals_sign = '\0';
-                strncpy(entity, line, MAX_ENTITY - 1);
-                entity[MAX_ENTITY - 1] = '\0';
-                strncpy(response, equals_sign + 1, MAX_RESPONSE - 1);
-                response[MAX_RESPONSE - 1] = '\0';
+    KnowledgeShard* copy = knowledge_new_shard(grow ? shard->capacity * 2 : shard->capacity);
+    if (copy == NULL) {
+        return NULL;
+    }
 
-                if (knowledge_put(intent, entity, response) == KB_OK) {
-                    count++;
-                }
-            }
+    int mask = copy->capacity - 1;
+    for (int i = 0; i < shard->capacity; i++) {
+        const KnowledgeSlot* slot = &shard->slots[i];
+        if (slot->entry == NULL) {
+            continue;
         }
+        int j = (int)((slot->hash / KB_SHARDS) & mask);
+        while (copy->slots[j].entry != NULL) {
+            j = (j + 1) & mask;
+        }
+        copy->slots[j] = *slot;
+        knowledge_retain(slot->entry);
     }
+    copy->count = shard->count;
 
-    return count;
+    knowledge_release_shard(shard);
+    return kb->shards[index] = copy;
 }
 
 
+/*
+ * Insert or overwrite an entry in the shard owning its entity. Unlike
+ * knowledge_put(), the response is stored as given and nothing is written
+ * to disk.
+ *
+ * Shared tables and entries are never written to: the shard's table is
+ * copied first if a snapshot shares it, and an entry that a snapshot or a
+ * view still holds is replaced rather than overwritten.
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_NOMEM, if there was a memory allocation failure
+ */
+static int knowledge_insert(KnowledgeBase *kb, const char *intent, const char *entity, const char *response) {
+    return knowledge_insert_hashed(kb, knowledge_hash(entity), intent, entity, response);
+}
+
 
-/* Author : Fitri
- * Reset the knowledge base, removing all know entitities from all intents.
+/*
+ * Insert or overwrite an entry, as knowledge_insert(), given the hash of
+ * its entity.
  */
-void knowledge_reset() {
-    // Free all nodes
-    while (knowledge_base != NULL) {
-        KnowledgeNode* temp = knowledge_base;
-        knowledge_base = knowledge_base->next;
-        free(temp);
+static int knowledge_insert_hashed(KnowledgeBase *kb, unsigned long hash, const char *intent, const char *entity, const char *response) {
+    int id = knowledge_intent_id(kb, intent, 1);
+    if (id < 0) {
+        return KB_NOMEM;
+    }
+
+    KnowledgeShard* shard = knowledge_own_shard(kb, (int)(hash & (KB_SHARDS - 1)));
+    if (shard == NULL) {
+        return KB_NOMEM;
     }
-    
-    // clear memory
-    knowledge_base = NULL;
+
+    KnowledgeSlot* slot = knowledge_probe(shard, hash, id, entity);
+    if (slot->entry != NULL && __atomic_load_n(&slot->entry->refs, __ATOMIC_ACQUIRE) == 1) {
+        // Nobody else can see the entry, so overwrite it where it is. Only
+        // this thread can hand out new references, so none can appear now.
+        strncpy(slot->entry->response, response, MAX_RESPONSE - 1);
+        slot->entry->response[MAX_RESPONSE - 1] = '\0';
+        slot->entry->from_default = 0;
+    } else {
+        KnowledgeEntry* entry = knowledge_new_entry(intent, entity, response);
+        if (entry == NULL) {
+            return KB_NOMEM;
+        }
+        if (slot->entry != NULL) {
+            // Keep the spelling the entry was first learned with
+            memcpy(entry->entity, slot->entry->entity, MAX_ENTITY);
+            knowledge_release(slot->entry);
+        } else {
+            slot->hash = (unsigned int)hash;
+            slot->intent = (unsigned short)id;
+            slot->entity_len = (unsigned short)strlen(entry->entity);
+            shard->count++;
+        }
+        slot->entry = entry;
+    }
+
+    knowledge_index_entry(kb, intent, entity, response);
+    return KB_OK;
 }
 
 
-/* Author : Fitri
- * Write the knowledge base to a file.
+/*
+ * Remove an entry from the shard owning its entity, if it has one. The
+ * default file's section for the intent is read first when the file is only
+ * partly loaded, so that the file cannot bring the entry back later.
  *
- * Input:
- *   f - the file
+ * The slots after the removed one are moved back into the gap where they
+ * can be, so that every entry stays reachable from its home slot without
+ * leaving markers behind. The indexes are rebuilt the next time they are
+ * used.
  */
-void knowledge_write(FILE *f) {
-    if (f == NULL) {
-        perror("Error opening file");
+static void knowledge_forget(KnowledgeBase *kb, const char *intent, const char *entity) {
+    knowledge_materialize(kb, intent);
+
+    unsigned long hash = knowledge_hash(entity);
+    if (knowledge_find(kb, hash, intent, entity) == NULL) {
         return;
     }
 
-    WrittenIntent* written_intents = NULL;
-    int written_count = 0;
-
-    KnowledgeNode *current = knowledge_base;
-    while (current != NULL) {
-        // Check if intent already written
-        WrittenIntent* check = written_intents;
-        int already_written = 0;
-        while (check != NULL) {
-            if (strcasecmp(check->intent, current->intent) == 0) {
-                already_written = 1;
-                break;
-            }
-            check = check->next;
-        }
+    KnowledgeShard* shard = knowledge_own_shard(kb, (int)(hash & (KB_SHARDS - 1)));
+    if (shard == NULL) {
+        return;
+    }
 
-        if (!already_written) {
-            // Write intent header
-            fprintf(f, "[%s]\n", current->intent);
-            
-            // Add to written intents
-            WrittenIntent* new_intent = malloc(sizeof(WrittenIntent));
-            if (new_intent != NULL) {
-                strncpy(new_intent->intent, current->intent, MAX_INTENT - 1);
-                new_intent->intent[MAX_INTENT - 1] = '\0';
-                new_intent->next = written_intents;
-                written_intents = new_intent;
-            }
+    KnowledgeSlot* slot = knowledge_probe(shard, hash, knowledge_intent_id(kb, intent, 0), entity);
+    knowledge_release(slot->entry);
+    slot->entry = NULL;
+    shard->count--;
 
-            // Write all matching entries
-            KnowledgeNode *inner = knowledge_base;
-            while (inner != NULL) {
-                if (strcasecmp(inner->intent, current->intent) == 0) {
-                    fprintf(f, "%s=%s\n", inner->entity, inner->response);
-                }
-                inner = inner->next;
-            }
-            fprintf(f, "\n");
+    int mask = shard->capacity - 1;
+    int hole = (int)(slot - shard->slots);
+    for (int i = (hole + 1) & mask; shard->slots[i].entry != NULL; i = (i + 1) & mask) {
+        // An entry can fill the gap unless its home slot lies between the two
+        int home = (int)((shard->slots[i].hash / KB_SHARDS) & mask);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            shard->slots[hole] = shard->slots[i];
+            shard->slots[i].entry = NULL;
+            hole = i;
         }
-        current = current->next;
     }
 
-    // Free written intents list
-    while (written_intents != NULL) {
-        WrittenIntent* next = written_intents->next;
-        free(written_intents);
-        written_intents = next;
-    }
-}
\ No newline at end of file
+    kb->indexes_stale = 1;
+}
+
+
+/*
+ * Read the next line of a knowledge or delta file, without its newline. No
+ * line the chatbot writes is too long for MAX_FILE_LINE, so a longer one is
+ * skipped whole rather than split, lest its tail be taken for another entry.
+ *
+ * Input:
+ *   f    - the file
+ *   line - a buffer of n characters to receive the line
+ *   n    - the size of the buffer
+ *
+ * Returns: 1 if a line was read, 0 at the end of the file
+ */
+static int knowledge_read_line(FILE *f, char *line, int n) {
+    while (fgets(line, n, f) != NULL) {
+        size_t len = strcspn(line, "\n");
+        if (line[len] == '\n' || feof(f)) {
+            line[len] = '\0';
+            return 1;
+        }
+
+        // Throw away the rest of the over-long line
+        int c;
+        while ((c = getc(f)) != EOF && c != '\n') {
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Insert every entry of an INI file into the knowledge base as it stands,
+ * without validating anything. Responses are punctuated as knowledge_put()
+ * would, and later lines win.
+ *
+ * Input:
+ *   f      - the file
+ *   forget - if set, a line holding just an entity removes that entity (as
+ *            a rollback writes to the delta file); otherwise it is ignored
+ *
+ * Returns: the number of entries in the file
+ */
+static int knowledge_load_file(KnowledgeBase *kb, FILE *f, int forget) {
+    char line[MAX_FILE_LINE];
+    char current_intent[MAX_INTENT] = "";
+    int count = 0;
+
+    while (knowledge_read_line(f, line, sizeof(line))) {
+        // Skip empty lines
+        if (strlen(line) == 0) continue;
+
+        // Check for section header
+        if (line[0] == '[') {
+            char* end = strchr(line, ']');
+            if (end) {
+                *end = '\0';
+                strncpy(current_intent, line + 1, MAX_INTENT - 1);
+                current_intent[MAX_INTENT - 1] = '\0';
+            }
+            continue;
+        }
+
+        // Parse entity=response pairs
+        char* separator = strchr(line, '=');
+        if (separator && strlen(current_intent) > 0) {
+            *separator = '\0';
+            char response[MAX_RESPONSE];
+            knowledge_punctuate(response, separator + 1, (int)strlen(separator + 1));
+            knowledge_insert(kb, current_intent, line, response);
+            count++;
+        } else if (forget && strlen(current_intent) > 0) {
+            knowledge_forget(kb, current_intent, line);
+            count++;
+        }
+    }
+    return count;
+}
+
+
+/*
+ * Populate an empty knowledge base from the default file, then apply the
+ * changes in its delta file on top.
+ */
+static void knowledge_load_default(KnowledgeBase *kb) {
+    FILE* f = fopen(kb->path, "r");
+    if (f != NULL) {
+        knowledge_load_file(kb, f, 0);
+        fclose(f);
+    }
+
+    knowledge_load_delta(kb);
+}
+
+
+/*
+ * Apply the changes in the default file's delta file. Later lines win, so
+ * the changes replace whatever the default file says about the same entries,
+ * and an entity on a line of its own is forgotten.
+ */
+static void knowledge_load_delta(KnowledgeBase *kb) {
+    FILE* f = fopen(kb->delta_path, "r");
+    if (f == NULL) {
+        kb->delta_count = 0;
+        return;
+    }
+
+    int stale = kb->indexes_stale;
+    kb->delta_count = knowledge_load_file(kb, f, 1);
+    fclose(f);
+
+    // A shared copy cannot have entries taken out of it, only be replaced
+    if (!stale && kb->indexes_stale) {
+        knowledge_share_all(kb);
+    }
+}
+
+
+/*
+ * Bring the knowledge base up to date before a lookup. A follower applies
+ * whatever the leader has published so far; anyone else falls back to the
+ * default file when the knowledge base is empty. The default file is opened
+ * through its sidecar index so that only the entries actually asked for are
+ * read; without an index it is read in full. The delta file is always read
+ * in full, and its entries take precedence over the default file's.
+ */
+static void knowledge_prepare(KnowledgeBase *kb) {
+    if (kb->shared_reader) {
+        return;
+    } else if (kb->replication_follower) {
+        knowledge_replicate_ctx(kb);
+    } else if (knowledge_is_empty(kb) && kb->lazy == NULL) {
+        kb->lazy = sidecar_open(kb->path);
+        if (kb->lazy == NULL) {
+            knowledge_load_default(kb);
+        } else {
+            knowledge_load_delta(kb);
+        }
+    }
+}
+
+
+/*
+ * Insert an entry read from the default file, punctuated as knowledge_put()
+ * would, unless the knowledge base already has a newer version of it (from
+ * the delta file or a change). An entry read from the default file earlier
+ * is replaced, so that when the file has an entity more than once the last
+ * line wins, as it does when the file is read in full.
+ */
+static void knowledge_insert_loaded(void *arg, const char *intent, const char *entity, const char *response) {
+    KnowledgeBase* kb = (KnowledgeBase*)arg;
+    unsigned long hash = knowledge_hash(entity);
+    KnowledgeEntry* entry = knowledge_find(kb, hash, intent, entity);
+    if (entry != NULL && !entry->from_default) {
+        return;
+    }
+
+    char punctuated[MAX_RESPONSE];
+    knowledge_punctuate(punctuated, response, (int)strlen(response));
+    if (knowledge_insert_hashed(kb, hash, intent, entity, punctuated) == KB_OK) {
+        knowledge_find(kb, hash, intent, entity)->from_default = 1;
+    }
+}
+
+
+/*
+ * Find an entry, reading it from the default file if that is only partly
+ * loaded.
+ *
+ * Returns: the entry, or NULL if there is none
+ */
+static KnowledgeEntry* knowledge_lookup(KnowledgeBase *kb, const char *intent, const char *entity) {
+    unsigned long hash = knowledge_hash(entity);
+    KnowledgeEntry* entry = knowledge_find(kb, hash, intent, entity);
+    if (entry != NULL || kb->lazy == NULL) {
+        return entry;
+    }
+
+    if (sidecar_find(kb->lazy, intent, entity, knowledge_insert_loaded, kb) != KB_OK) {
+        return NULL;
+    }
+    return knowledge_find(kb, hash, intent, entity);
+}
+
+
+/*
+ * Get a response from shared memory, waiting out a publisher that keeps
+ * changing it for up to about KB_SHARED_WAIT * KB_SHARED_PAUSE nanoseconds.
+ *
+ * Returns: as shared_get(), KB_BUSY only if the publisher never stopped
+ */
+static int knowledge_shared_get(KnowledgeBase *kb, const char *intent, const char *entity, char *response, int n) {
+    int result = shared_get(kb->shared, intent, entity, response, n);
+    for (int tries = 0; result == KB_BUSY && tries < KB_SHARED_WAIT; tries++) {
+#ifndef _WIN32
+        struct timespec pause = { 0, KB_SHARED_PAUSE };
+        nanosleep(&pause, NULL);
+#endif
+        result = shared_get(kb->shared, intent, entity, response, n);
+    }
+    return result;
+}
+
+
+/*
+ * Read the rest of a partly loaded default file.
+ *
+ * Input:
+ *   intent - only read the sections for this question word, or NULL to read
+ *            everything (after which the file is no longer partly loaded)
+ */
+static void knowledge_materialize(KnowledgeBase *kb, const char *intent) {
+    if (kb->lazy == NULL) {
+        return;
+    }
+
+    sidecar_read_section(kb->lazy, intent, knowledge_insert_loaded, kb);
+    if (intent == NULL) {
+        knowledge_discard_lazy(kb);
+    }
+}
+
+
+/*
+ * Forget the rest of a partly loaded default file.
+ */
+static void knowledge_discard_lazy(KnowledgeBase *kb) {
+    sidecar_close(kb->lazy);
+    kb->lazy = NULL;
+}
+
+/*
+ * Create an empty knowledge base, independent of every other one.
+ *
+ * Input:
+ *   path - the knowledge base's default file, which it is loaded from on
+ *          first use and saved to after every change (with the changes kept
+ *          in "path.delta" until they are folded in)
+ *
+ * Returns: the knowledge base, or NULL if the inputs are invalid or there
+ *          was a memory allocation failure
+ */
+KnowledgeBase *knowledge_create(const char *path) {
+    if (path == NULL || strlen(path) >= KB_MAX_PATH) {
+        return NULL;
+    }
+
+    KnowledgeBase* kb = (KnowledgeBase*)calloc(1, sizeof(KnowledgeBase));
+    if (kb == NULL) {
+        return NULL;
+    }
+    strcpy(kb->path, path);
+    sprintf(kb->delta_path, "%s.delta", path);
+    return kb;
+}
+
+
+/*
+ * Free a knowledge base made with knowledge_create(), with its snapshots.
+ * Responses still held by knowledge_view_ctx() stay valid until they are
+ * released. The default file is left as it is.
+ *
+ * Input:
+ *   kb - the knowledge base
+ */
+void knowledge_destroy(KnowledgeBase *kb) {
+    if (kb == NULL || kb == &knowledge_default) {
+        return;
+    }
+
+    for (int i = 0; i < KB_SHARDS; i++) {
+        knowledge_release_shard(kb->shards[i]);
+    }
+    while (kb->snapshots != NULL) {
+        KnowledgeSnapshot* next = kb->snapshots->next;
+        knowledge_free_snapshot(kb->snapshots);
+        kb->snapshots = next;
+    }
+
+    knowledge_clear_dirty(kb);
+    free(kb->dirty);
+    search_destroy(kb->index);
+    spot_destroy(kb->spotter);
+    vector_destroy(kb->vectors);
+    knowledge_save_misses_ctx(kb);
+    misses_destroy(kb->misses);
+    sidecar_close(kb->lazy);
+    shared_close(kb->shared);
+    if (kb->replication_log != NULL) {
+        fclose(kb->replication_log);
+    }
+    free(kb);
+}
+
+
+/* Author : Hafiz
+ * Get the response to a question.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - a buffer to receive the response
+ *   n        - the maximum number of characters to write to the response buffer
+ *
+ * Returns:
+ *   KB_OK, if a response was found for the intent and entity (the response is copied to the response buffer)
+ *   KB_NOTFOUND, if no response could be found
+ *   KB_BUSY, if this is a shared-memory reader and the publisher kept changing the entries
+ *   KB_INVALID, if 'intent' is not a recognised question word
+ */
+// Get the response to a question
+
+int knowledge_get_ctx(KnowledgeBase *kb, const char *intent, const char *entity, char *response, int n) {
+    kb = knowledge_base_of(kb);
+    // Validate inputs
+    if (intent == NULL || entity == NULL || response == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+    if (kb->shared_reader) {
+        return knowledge_shared_get(kb, intent, entity, response, n);
+    }
+
+    knowledge_prepare(kb);
+
+    // Search the shard owning the entity
+    KnowledgeEntry* current = knowledge_lookup(kb, intent, entity);
+    if (current == NULL) {
+        return KB_NOTFOUND;
+    }
+
+    strncpy(response, current->response, n - 1);
+    response[n - 1] = '\0';
+    return KB_OK;
+}
+
+
+/*
+ * Get the response to a question without copying it. The response stays
+ * valid, unchanged, until it is given back to knowledge_view_release(), even
+ * if the entry is replaced or the knowledge base is reset in the meantime:
+ * the view holds a reference to the entry, and shared entries are never
+ * modified. A view may be released from any thread.
+ *
+ * A shared-memory reader has no entries of its own, and the publisher may
+ * change its copy at any time, so the reader copies the response into an
+ * entry made for the view alone.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - receives a pointer to the response
+ *   len      - receives the length of the response, or NULL
+ *
+ * Returns:
+ *   KB_OK, if a response was found (release it with knowledge_view_release())
+ *   KB_NOTFOUND, if no response could be found
+ *   KB_BUSY, as knowledge_get()
+ *   KB_INVALID, if the inputs are invalid
+ *   KB_NOMEM, if there was a memory allocation failure
+ */
+int knowledge_view_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char **response, int *len) {
+    kb = knowledge_base_of(kb);
+    if (intent == NULL || entity == NULL || response == NULL) {
+        return KB_INVALID;
+    }
+
+    KnowledgeEntry* entry;
+    if (kb->shared_reader) {
+        entry = knowledge_new_entry(intent, entity, "");
+        if (entry == NULL) {
+            return KB_NOMEM;
+        }
+        int result = knowledge_shared_get(kb, intent, entity, entry->response, MAX_RESPONSE);
+        if (result != KB_OK) {
+            free(entry);
+            return result;
+        }
+    } else {
+        knowledge_prepare(kb);
+
+        entry = knowledge_lookup(kb, intent, entity);
+        if (entry == NULL) {
+            return KB_NOTFOUND;
+        }
+        knowledge_retain(entry);
+    }
+
+    *response = entry->response;
+    if (len != NULL) {
+        *len = (int)strlen(entry->response);
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Give back a response obtained from knowledge_view().
+ *
+ * Input:
+ *   response - the pointer knowledge_view() returned
+ */
+void knowledge_view_release(const char *response) {
+    if (response != NULL) {
+        knowledge_release((KnowledgeEntry*)(response - offsetof(KnowledgeEntry, response)));
+    }
+}
+
+
+/*
+ * Get the responses to many questions at once. The home slots of a whole
+ * group of keys are located and prefetched before any of them is searched, so the
+ * cache misses of independent lookups overlap instead of being taken one
+ * after the other.
+ *
+ * Input:
+ *   kb        - the knowledge base, or NULL for the default one
+ *   keys      - the intent and entity of each question
+ *   count     - the number of keys
+ *   responses - a buffer to receive the response for each key
+ *   n         - the maximum number of characters to write to each response buffer
+ *   results   - receives the result of each lookup, as knowledge_get()
+ *
+ * Returns: the number of keys for which a response was found
+ */
+int knowledge_get_many_ctx(KnowledgeBase *kb, const KnowledgeKey *keys, int count, char *responses[], int n, int results[]) {
+    kb = knowledge_base_of(kb);
+    if (keys == NULL || responses == NULL || results == NULL || n <= 0) {
+        return 0;
+    }
+
+    unsigned long hashes[KB_PREFETCH_GROUP];
+    int found = 0;
+
+    if (kb->shared_reader) {
+        for (int i = 0; i < count; i++) {
+            results[i] = knowledge_shared_get(kb, keys[i].intent, keys[i].entity, responses[i], n);
+            found += results[i] == KB_OK;
+        }
+        return found;
+    }
+
+    knowledge_prepare(kb);
+
+    for (int base = 0; base < count; base += KB_PREFETCH_GROUP) {
+        int group = count - base < KB_PREFETCH_GROUP ? count - base : KB_PREFETCH_GROUP;
+
+        // Hash every key in the group and start fetching its home slot
+        for (int i = 0; i < group; i++) {
+            const KnowledgeKey* key = &keys[base + i];
+            hashes[i] = 0;
+            if (key->intent != NULL && key->entity != NULL) {
+                hashes[i] = knowledge_hash(key->entity);
+                KnowledgeShard* shard = kb->shards[hashes[i] & (KB_SHARDS - 1)];
+                if (shard != NULL) {
+                    KB_PREFETCH(&shard->slots[(hashes[i] / KB_SHARDS) & (shard->capacity - 1)]);
+                }
+            }
+        }
+
+        // Then resolve them while the lines arrive
+        for (int i = 0; i < group; i++) {
+            const KnowledgeKey* key = &keys[base + i];
+            if (key->intent == NULL || key->entity == NULL || responses[base + i] == NULL) {
+                results[base + i] = KB_INVALID;
+                continue;
+            }
+
+            KnowledgeEntry* entry = knowledge_find(kb, hashes[i], key->intent, key->entity);
+            if (entry == NULL && kb->lazy != NULL) {
+                entry = knowledge_lookup(kb, key->intent, key->entity);
+            }
+            if (entry == NULL) {
+                results[base + i] = KB_NOTFOUND;
+                continue;
+            }
+
+            strncpy(responses[base + i], entry->response, n - 1);
+            responses[base + i][n - 1] = '\0';
+            results[base + i] = KB_OK;
+            found++;
+        }
+    }
+
+    return found;
+}
+
+ 
+
+
+/* Author : Harith
+ * Insert a new response to a question. If a response already exists for the
+ * given intent and entity, it will be overwritten. Otherwise, it will be added
+ * to the knowledge base.
+ *
+ * Input:
+ *   kb        - the knowledge base, or NULL for the default one
+ *   intent    - the question word
+ *   entity    - the entity
+ *   response  - the response for this question and entity
+ *
+ * Returns:
+ *   KB_FOUND, if successful
+ *   KB_NOMEM, if there was a memory allocation failure
+ *   KB_INVALID, if the intent is not a valid question word
+ */
+int knowledge_put_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char *response) {
+    kb = knowledge_base_of(kb);
+    // Validate inputs
+    if (intent == NULL || entity == NULL || response == NULL) {
+        return KB_INVALID;
+    }
+
+    // Read replicas only learn from the leader
+    if (knowledge_is_replica_ctx(kb)) {
+        return KB_INVALID;
+    }
+
+    // Validate intent if it is a recognized question word
+    if (!knowledge_valid_intent(intent, (int)strlen(intent))) {
+        return KB_INVALID;
+    }
+
+    // Prepare response with period if required
+    char temp_response[MAX_RESPONSE];
+    knowledge_punctuate(temp_response, response, (int)strlen(response));
+
+    // The default file must be opened first, so that the change goes on top
+    // of it rather than replacing it
+    knowledge_prepare(kb);
+
+    // First update/add to the owning shard
+    if (knowledge_insert(kb, intent, entity, temp_response) == KB_NOMEM) {
+        return KB_NOMEM;
+    }
+    knowledge_log_put(kb, intent, entity, temp_response);
+
+    // The question is no longer unanswered
+    if (kb->misses != NULL) {
+        misses_remove(kb->misses, intent, entity);
+        kb->misses_changed = 1;
+    }
+
+    // Then record just this change on disk
+    if (knowledge_mark_dirty(kb, intent, entity) != KB_OK) {
+        return knowledge_save_default(kb);
+    }
+    return knowledge_save_changes(kb);
+}
+
+
+/*
+ * Copy a response, ending it with a period if it does not have one.
+ *
+ * Input:
+ *   out      - a buffer of MAX_RESPONSE characters
+ *   response - the response
+ *   len      - the number of characters of the response to use
+ */
+static void knowledge_punctuate(char *out, const char *response, int len) {
+    if (len > MAX_RESPONSE - 2) {
+        len = MAX_RESPONSE - 2;
+    }
+    memcpy(out, response, len);
+    out[len] = '\0';
+    if (len > 0 && out[len - 1] != '.') {
+        out[len] = '.';
+        out[len + 1] = '\0';
+    }
+}
+
+
+/*
+ * Determine whether an intent is one knowledge_put() accepts.
+ *
+ * Input:
+ *   intent - the intent
+ *   len    - the number of characters of the intent to use
+ */
+static int knowledge_valid_intent(const char *intent, int len) {
+    return (len == 4 && strncasecmp(intent, "what", 4) == 0) ||
+           (len == 5 && strncasecmp(intent, "where", 5) == 0) ||
+           (len == 3 && strncasecmp(intent, "who", 3) == 0);
+}
+
+
+/*
+ * Rewrite the default file from the current knowledge base, folding in and
+ * removing the delta file.
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the file could not be opened
+ */
+static int knowledge_save_default(KnowledgeBase *kb) {
+    // The file is about to be rewritten from memory, so memory must hold all of it
+    knowledge_materialize(kb, NULL);
+
+    // Write the new file beside the old one, which snapshots may still be
+    // reading, and rename it into place
+    char temp[KB_MAX_PATH + 4];
+    snprintf(temp, sizeof(temp), "%s.new", kb->path);
+    FILE* f = fopen(temp, "w");
+    if (f == NULL) {
+        return KB_INVALID;
+    }
+
+    // Write sections [what, where, who]
+    const char* sections[] = {"what", "where", "who"};
+    for (int i = 0; i < 3; i++) {
+        int section_started = 0;
+
+        // Go through all entries for section in every shard
+        KnowledgeCursor cursor = { 0, -1 };
+        for (KnowledgeEntry* current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+            if (strcasecmp(current->intent, sections[i]) == 0) {
+                if (!section_started) {
+                    fprintf(f, "\n[%s]\n", sections[i]);
+                    section_started = 1;
+                }
+                fprintf(f, "%s=%s\n", current->entity, current->response);
+            }
+        }
+    }
+
+    if (fclose(f) != 0 || knowledge_replace_file(temp, kb->path) != KB_OK) {
+        remove(temp);
+        return KB_INVALID;
+    }
+
+    // Every change is in the default file now
+    knowledge_clear_dirty(kb);
+    remove(kb->delta_path);
+    kb->delta_count = 0;
+    kb->file_version++;
+    return KB_OK;
+}
+
+
+/*
+ * Move a newly written file over an old one. Anything that still has the
+ * old file open keeps reading the old version.
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the file could not be renamed
+ */
+static int knowledge_replace_file(const char *temp, const char *path) {
+    if (rename(temp, path) == 0) {
+        return KB_OK;
+    }
+
+    // Some systems will not rename over an existing file
+    remove(path);
+    return rename(temp, path) == 0 ? KB_OK : KB_INVALID;
+}
+
+
+/*
+ * Note that an entry has changed and needs saving.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int knowledge_mark_dirty(KnowledgeBase *kb, const char *intent, const char *entity) {
+    KnowledgeEntry* entry = knowledge_find(kb, knowledge_hash(entity), intent, entity);
+    if (entry == NULL) {
+        return KB_NOMEM;
+    }
+
+    if (kb->dirty_count == kb->dirty_capacity) {
+        int capacity = kb->dirty_capacity == 0 ? 16 : kb->dirty_capacity * 2;
+        KnowledgeEntry** dirty = (KnowledgeEntry**)realloc(kb->dirty, capacity * sizeof(KnowledgeEntry*));
+        if (dirty == NULL) {
+            return KB_NOMEM;
+        }
+        kb->dirty = dirty;
+        kb->dirty_capacity = capacity;
+    }
+
+    // Holding the entry keeps it from being overwritten in place, so each
+    // dirty entry is exactly what its change made
+    entry->seq = ++kb->change_seq;
+    knowledge_retain(entry);
+    kb->dirty[kb->dirty_count++] = entry;
+    return KB_OK;
+}
+
+
+/*
+ * Forget the changes waiting to be saved.
+ */
+static void knowledge_clear_dirty(KnowledgeBase *kb) {
+    for (int i = 0; i < kb->dirty_count; i++) {
+        knowledge_release(kb->dirty[i]);
+    }
+    kb->dirty_count = 0;
+}
+
+
+/*
+ * Save the changes made since the last save by appending them to the delta
+ * file, so that the cost depends on the number of changes rather than the
+ * size of the knowledge base. A change that a later one has superseded is
+ * skipped. Once the delta file has grown to half the size of the knowledge
+ * base, the default file is rewritten instead.
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the file could not be opened (the changes are kept for the next save)
+ */
+static int knowledge_save_changes(KnowledgeBase *kb) {
+    if (kb->dirty_count == 0) {
+        return KB_OK;
+    }
+
+    long entries = 0;
+    for (int i = 0; i < KB_SHARDS; i++) {
+        if (kb->shards[i] != NULL) {
+            entries += kb->shards[i]->count;
+        }
+    }
+    long delta = kb->delta_count + kb->dirty_count;
+    if (delta >= KB_DELTA_MIN && delta * 2 > entries) {
+        return knowledge_save_default(kb);
+    }
+
+    FILE* f = fopen(kb->delta_path, "a");
+    if (f == NULL) {
+        return KB_INVALID;
+    }
+
+    const char* section = NULL;
+    for (int i = 0; i < kb->dirty_count; i++) {
+        KnowledgeEntry* entry = kb->dirty[i];
+        KnowledgeEntry* live = knowledge_find(kb, knowledge_hash(entry->entity), entry->intent, entry->entity);
+        if (live == NULL || live->seq != entry->seq) {
+            continue;
+        }
+
+        if (section == NULL || strcasecmp(section, entry->intent) != 0) {
+            fprintf(f, "[%s]\n", entry->intent);
+            section = entry->intent;
+        }
+        fprintf(f, "%s=%s\n", entry->entity, entry->response);
+        kb->delta_count++;
+    }
+    fclose(f);
+
+    knowledge_clear_dirty(kb);
+    return KB_OK;
+}
+
+
+/*
+ * Find the end of the line starting at p.
+ *
+ * Returns: the position of the line's newline, or 'end' if it has none
+ */
+static const char* knowledge_line_end(const char *p, const char *end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl != NULL ? nl : end;
+}
+
+
+/*
+ * Parse one chunk of a knowledge file: every line starting in [start, end).
+ * A chunk cannot know which section it starts in without reading the chunks
+ * before it, so its entries before its first [section] header are kept with
+ * no intent, and the merge gives them the section the previous chunk leaves
+ * open. Nothing in the file is modified, so chunks can be parsed at the same
+ * time.
+ */
+static void* knowledge_parse_chunk(void *arg) {
+    LoadChunk* chunk = (LoadChunk*)arg;
+    const char* intent = NULL;
+    int intent_len = 0;
+
+    for (const char* line = chunk->start; line < chunk->end; ) {
+        const char* eol = knowledge_line_end(line, chunk->file_end);
+        const char* next = eol < chunk->file_end ? eol + 1 : eol;
+        if (eol > line && eol[-1] == '\r') {
+            eol--;
+        }
+
+        if (line[0] == '[') {
+            const char* close = (const char*)memchr(line, ']', eol - line);
+            intent = close != NULL ? line + 1 : NULL;
+            intent_len = close != NULL ? (int)(close - intent) : 0;
+            chunk->seen_header = 1;
+        } else if (!chunk->seen_header || (intent != NULL && knowledge_valid_intent(intent, intent_len))) {
+            // Entries before the first header belong to whichever section
+            // the previous chunks leave open; the merge fills that in
+            const char* equals_sign = (const char*)memchr(line, '=', eol - line);
+            if (equals_sign != NULL) {
+                if (chunk->count == chunk->capacity) {
+                    int capacity = chunk->capacity == 0 ? 256 : chunk->capacity * 2;
+                    LoadEntry* entries = (LoadEntry*)realloc(chunk->entries, capacity * sizeof(LoadEntry));
+                    if (entries == NULL) {
+                        chunk->failed = 1;
+                        return NULL;
+                    }
+                    chunk->entries = entries;
+                    chunk->capacity = capacity;
+                }
+
+                LoadEntry* entry = &chunk->entries[chunk->count++];
+                entry->intent = intent;
+                entry->intent_len = intent_len;
+                entry->entity = line;
+                entry->entity_len = (int)(equals_sign - line) < MAX_ENTITY - 1 ? (int)(equals_sign - line) : MAX_ENTITY - 1;
+                entry->response = equals_sign + 1;
+                entry->response_len = (int)(eol - entry->response);
+                entry->hash = knowledge_hash_bytes(entry->entity, entry->entity_len);
+            }
+        }
+
+        line = next;
+    }
+
+    chunk->last_intent = intent;
+    chunk->last_intent_len = intent_len;
+    return NULL;
+}
+
+
+/*
+ * Decide how many threads to parse a file of a given size with.
+ */
+static int knowledge_load_threads(long size) {
+    long threads = size / KB_LOAD_CHUNK + 1;
+
+#if !defined(KB_NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0 && threads > cores) {
+        threads = cores;
+    }
+#elif defined(KB_NO_THREADS)
+    threads = 1;
+#endif
+
+    return threads < KB_LOAD_THREADS ? (int)threads : KB_LOAD_THREADS;
+}
+
+
+/* Author : Hafiz
+ * Read a knowledge base from a file.
+ *
+ * The file is read into memory and split at line boundaries into chunks
+ * that are parsed and hashed in parallel. The parsed entries are then put
+ * into the knowledge base in file order, so a later entry for the same
+ * intent and entity wins exactly as if the file were read line by line, and
+ * the default file is rewritten once at the end rather than once per entry.
+ * A load that is large next to the knowledge base marks the indexes for one
+ * rebuild instead of updating them entry by entry, and the puts it publishes
+ * to a replication log are flushed once.
+ *
+ * Input:
+ *   kb- the knowledge base, or NULL for the default one
+ *   f - the file
+ *
+ * Returns: the number of entity/response pairs successful read from the file
+ */
+int knowledge_read_ctx(KnowledgeBase *kb, FILE *f) {
+    kb = knowledge_base_of(kb);
+    if (f == NULL || knowledge_is_replica_ctx(kb)) {
+        return 0;
+    }
+
+    // Read the whole file
+    char* file = NULL;
+    long size = 0, capacity = 0;
+    for (;;) {
+        if (size == capacity) {
+            capacity = capacity == 0 ? 65536 : capacity * 2;
+            char* grown = (char*)realloc(file, capacity);
+            if (grown == NULL) {
+                free(file);
+                return 0;
+            }
+            file = grown;
+        }
+        size_t got = fread(file + size, 1, capacity - size, f);
+        if (got == 0) {
+            break;
+        }
+        size += (long)got;
+    }
+
+    // Split it into chunks that each begin at the start of a line
+    LoadChunk chunks[KB_LOAD_THREADS];
+    int chunk_count = knowledge_load_threads(size);
+    memset(chunks, 0, sizeof(chunks));
+
+    const char* start = file;
+    for (int i = 0; i < chunk_count; i++) {
+        const char* end = file + size * (i + 1) / chunk_count;
+        if (end < start) {
+            end = start;
+        }
+        if (i < chunk_count - 1 && end > file && end < file + size && end[-1] != '\n') {
+            end = knowledge_line_end(end, file + size);
+            if (end < file + size) {
+                end++;
+            }
+        }
+        chunks[i].file = file;
+        chunks[i].file_end = file + size;
+        chunks[i].start = start;
+        chunks[i].end = end;
+        start = end;
+    }
+
+    // Parse them at the same time
+#ifndef KB_NO_THREADS
+    pthread_t threads[KB_LOAD_THREADS];
+    int started[KB_LOAD_THREADS];
+    for (int i = 1; i < chunk_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, knowledge_parse_chunk, &chunks[i]) == 0;
+        if (!started[i]) {
+            knowledge_parse_chunk(&chunks[i]);
+        }
+    }
+    knowledge_parse_chunk(&chunks[0]);
+    for (int i = 1; i < chunk_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (int i = 0; i < chunk_count; i++) {
+        knowledge_parse_chunk(&chunks[i]);
+    }
+#endif
+
+    // Load all of the file or none of it
+    for (int i = 0; i < chunk_count; i++) {
+        if (chunks[i].failed) {
+            for (int j = 0; j < chunk_count; j++) {
+                free(chunks[j].entries);
+            }
+            free(file);
+            return 0;
+        }
+    }
+
+    // Merge the chunks in order; the file is rewritten from memory at the
+    // end, so memory must hold all of it
+    knowledge_materialize(kb, NULL);
+
+    long loaded = 0, entries = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        loaded += chunks[i].count;
+    }
+    for (int i = 0; i < KB_SHARDS; i++) {
+        if (kb->shards[i] != NULL) {
+            entries += kb->shards[i]->count;
+        }
+    }
+    if (loaded * 4 >= entries) {
+        kb->indexes_stale = 1;
+    }
+    kb->replication_batch = 1;
+
+    int count = 0;
+    const char* open_intent = NULL;
+    int open_intent_len = 0;
+    char intent[MAX_INTENT];
+    char entity[MAX_ENTITY];
+    char response[MAX_RESPONSE];
+    for (int i = 0; i < chunk_count; i++) {
+        for (int j = 0; j < chunks[i].count; j++) {
+            const LoadEntry* entry = &chunks[i].entries[j];
+            const char* section = entry->intent != NULL ? entry->intent : open_intent;
+            int section_len = entry->intent != NULL ? entry->intent_len : open_intent_len;
+            if (section == NULL || !knowledge_valid_intent(section, section_len)) {
+                continue;
+            }
+
+            memcpy(intent, section, section_len);
+            intent[section_len] = '\0';
+            memcpy(entity, entry->entity, entry->entity_len);
+            entity[entry->entity_len] = '\0';
+            knowledge_punctuate(response, entry->response, entry->response_len);
+
+            if (knowledge_insert_hashed(kb, entry->hash, intent, entity, response) == KB_OK) {
+                knowledge_log_put(kb, intent, entity, response);
+                count++;
+            }
+        }
+        if (chunks[i].seen_header) {
+            open_intent = chunks[i].last_intent;
+            open_intent_len = chunks[i].last_intent_len;
+        }
+        free(chunks[i].entries);
+    }
+    free(file);
+
+    kb->replication_batch = 0;
+    if (kb->replication_log != NULL) {
+        fflush(kb->replication_log);
+    }
+
+    if (count > 0) {
+        knowledge_save_default(kb);
+    }
+    return count;
+}
+
+
+
+/* Author : Fitri
+ * Reset the knowledge base, removing all know entitities from all intents.
+ *
+ * Input:
+ *   kb - the knowledge base, or NULL for the default one
+ */
+void knowledge_reset_ctx(KnowledgeBase *kb) {
+    kb = knowledge_base_of(kb);
+    // Drop every shard; tables and entries still held by a snapshot survive
+    for (int i = 0; i < KB_SHARDS; i++) {
+        knowledge_release_shard(kb->shards[i]);
+        kb->shards[i] = NULL;
+    }
+    search_clear(kb->index);
+    spot_clear(kb->spotter);
+    vector_clear(kb->vectors);
+    if (kb->misses != NULL) {
+        misses_clear(kb->misses);
+        kb->misses_changed = 1;
+    }
+    kb->indexes_stale = 0;
+    knowledge_discard_lazy(kb);
+    knowledge_clear_dirty(kb);
+    knowledge_share_all(kb);
+
+    // Memory no longer matches the files, which still hold what was reset
+    kb->file_version++;
+
+    knowledge_log_record(kb, "R\n");
+}
+
+
+/*
+ * Reset the knowledge base and empty its default file, leaving just the
+ * section headers, and remove its delta file.
+ *
+ * Input:
+ *   kb - the knowledge base, or NULL for the default one
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if this is a follower or the file could not be written
+ */
+int knowledge_erase_ctx(KnowledgeBase *kb) {
+    kb = knowledge_base_of(kb);
+    if (knowledge_is_replica_ctx(kb)) {
+        return KB_INVALID;
+    }
+
+    knowledge_reset_ctx(kb);
+
+    char temp[KB_MAX_PATH + 4];
+    snprintf(temp, sizeof(temp), "%s.new", kb->path);
+    FILE* f = fopen(temp, "w");
+    if (f == NULL) {
+        return KB_INVALID;
+    }
+    fprintf(f, "[what]\n\n[where]\n\n[who]\n");
+    if (fclose(f) != 0 || knowledge_replace_file(temp, kb->path) != KB_OK) {
+        remove(temp);
+        return KB_INVALID;
+    }
+
+    remove(kb->delta_path);
+    kb->delta_count = 0;
+    return KB_OK;
+}
+
+
+/* Author : Fitri
+ * Write the knowledge base to a file.
+ *
+ * Input:
+ *   kb- the knowledge base, or NULL for the default one
+ *   f - the file
+ */
+void knowledge_write_ctx(KnowledgeBase *kb, FILE *f) {
+    kb = knowledge_base_of(kb);
+    if (f == NULL) {
+        perror("Error opening file");
+        return;
+    }
+
+    knowledge_materialize(kb, NULL);
+
+    // A leader's save doubles as a bootstrap snapshot for new followers
+    if (kb->replication_log != NULL && !kb->replication_follower) {
+        fflush(kb->replication_log);
+        fprintf(f, "; log offset %ld\n\n", ftell(kb->replication_log));
+    }
+
+    WrittenIntent* written_intents = NULL;
+
+    KnowledgeCursor cursor = { 0, -1 };
+    for (KnowledgeEntry *current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+        // Check if intent already written
+        WrittenIntent* check = written_intents;
+        int already_written = 0;
+        while (check != NULL) {
+            if (strcasecmp(check->intent, current->intent) == 0) {
+                already_written = 1;
+                break;
+            }
+            check = check->next;
+        }
+
+        if (already_written) {
+            continue;
+        }
+
+        // Write intent header
+        fprintf(f, "[%s]\n", current->intent);
+
+        // Add to written intents
+        WrittenIntent* new_intent = malloc(sizeof(WrittenIntent));
+        if (new_intent != NULL) {
+            strncpy(new_intent->intent, current->intent, MAX_INTENT - 1);
+            new_intent->intent[MAX_INTENT - 1] = '\0';
+            new_intent->next = written_intents;
+            written_intents = new_intent;
+        }
+
+        // Gather the matching entries from every shard
+        KnowledgeCursor inner_cursor = { 0, -1 };
+        for (KnowledgeEntry *inner = knowledge_next(kb, &inner_cursor); inner != NULL; inner = knowledge_next(kb, &inner_cursor)) {
+            if (strcasecmp(inner->intent, current->intent) == 0) {
+                fprintf(f, "%s=%s\n", inner->entity, inner->response);
+            }
+        }
+        fprintf(f, "\n");
+    }
+
+    // Free written intents list
+    while (written_intents != NULL) {
+        WrittenIntent* next = written_intents->next;
+        free(written_intents);
+        written_intents = next;
+    }
+}
+
+
+/*
+ * Publish the knowledge base, and every subsequent mutation of it, to a
+ * replication log. Records are appended one per line and flushed immediately:
+ *   P<tab>intent<tab>entity<tab>response - knowledge_put()
+ *   R                                     - knowledge_reset()
+ *   S<tab>name                            - knowledge_snapshot()
+ *   B<tab>name                            - knowledge_rollback()
+ *   D<tab>name                            - knowledge_drop_snapshot()
+ * Tabs, newlines and backslashes in the fields are escaped as \t, \n and \\.
+ * Loading a file is published as the puts it performs. The entries the
+ * knowledge base already holds, including any not yet read from its default
+ * file, are published first as a reset followed by a put for each.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   path - the log file, shared with the followers
+ *
+ * Returns:
+ *   KB_OK, if the log was opened
+ *   KB_INVALID, if the log could not be opened or this is a follower
+ */
+int knowledge_publish_ctx(KnowledgeBase *kb, const char *path) {
+    kb = knowledge_base_of(kb);
+    if (path == NULL || kb->replication_follower) {
+        return KB_INVALID;
+    }
+
+    FILE* f = fopen(path, "a");
+    if (f == NULL) {
+        return KB_INVALID;
+    }
+
+    if (kb->replication_log != NULL) {
+        fclose(kb->replication_log);
+    }
+    kb->replication_log = f;
+
+    // Followers replaying the log from the start must end up with what is
+    // here now, not just with what changes from here on
+    knowledge_prepare(kb);
+    knowledge_materialize(kb, NULL);
+    knowledge_log_record(kb, "R\n");
+    KnowledgeCursor cursor = { 0, -1 };
+    for (KnowledgeEntry* current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+        knowledge_log_put(kb, current->intent, current->entity, current->response);
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Become a read-only follower of a leader's replication log. The follower
+ * bootstraps from a snapshot saved by the leader (which records the log
+ * offset it corresponds to), or replays the whole log if there is none,
+ * and then catches up with the log before every knowledge_get(). The
+ * snapshot is read as the default file is, so entries as long as the log
+ * can carry are read whole and a line longer than any entry is skipped.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   path     - the leader's log file
+ *   snapshot - a file saved by the leader, or NULL
+ *
+ * Returns:
+ *   KB_OK, if the follower was started
+ *   KB_INVALID, if a file could not be opened or this is a leader
+ */
+int knowledge_follow_ctx(KnowledgeBase *kb, const char *path, const char *snapshot) {
+    kb = knowledge_base_of(kb);
+    if (path == NULL || (kb->replication_log != NULL && !kb->replication_follower)) {
+        return KB_INVALID;
+    }
+
+    FILE* log = fopen(path, "r");
+    if (log == NULL) {
+        return KB_INVALID;
+    }
+
+    long offset = 0;
+    if (snapshot != NULL) {
+        FILE* f = fopen(snapshot, "r");
+        if (f == NULL) {
+            fclose(log);
+            return KB_INVALID;
+        }
+
+        char line[MAX_FILE_LINE];
+        if (!knowledge_read_line(f, line, sizeof(line)) || sscanf(line, "; log offset %ld", &offset) != 1) {
+            offset = 0;
+        }
+        rewind(f);
+        knowledge_load_file(kb, f, 0);
+        fclose(f);
+    }
+
+    if (kb->replication_log != NULL) {
+        fclose(kb->replication_log);
+    }
+    kb->replication_log = log;
+    kb->replication_follower = 1;
+    kb->replication_offset = offset;
+
+    knowledge_replicate_ctx(kb);
+    return KB_OK;
+}
+
+
+/*
+ * Apply the records a follower has not seen yet. A record the leader is
+ * still writing (no newline yet) is left for the next call; one longer
+ * than MAX_LOG_RECORD cannot have been written by a leader and is skipped.
+ *
+ * Input:
+ *   kb - the knowledge base, or NULL for the default one
+ *
+ * Returns: the number of records applied
+ */
+int knowledge_replicate_ctx(KnowledgeBase *kb) {
+    kb = knowledge_base_of(kb);
+    if (!kb->replication_follower || kb->replication_log == NULL) {
+        return 0;
+    }
+
+    char line[MAX_LOG_RECORD];
+    int count = 0;
+
+    clearerr(kb->replication_log);
+    fseek(kb->replication_log, kb->replication_offset, SEEK_SET);
+    while (fgets(line, sizeof(line), kb->replication_log) != NULL) {
+        char *newline = strchr(line, '\n');
+        if (newline == NULL) {
+            if (strlen(line) < sizeof(line) - 1) {
+                break;
+            }
+
+            // Too long to be a record; skip it once it has been written in full
+            int c;
+            while ((c = fgetc(kb->replication_log)) != EOF && c != '\n') {
+            }
+            if (c == EOF) {
+                break;
+            }
+            kb->replication_offset = ftell(kb->replication_log);
+            continue;
+        }
+        *newline = '\0';
+        kb->replication_offset = ftell(kb->replication_log);
+
+        if (line[0] == 'R') {
+            knowledge_reset_ctx(kb);
+        } else if ((line[0] == 'S' || line[0] == 'B' || line[0] == 'D') && line[1] == '\t') {
+            knowledge_unescape(line + 2);
+            if (line[0] == 'S') {
+                knowledge_snapshot_ctx(kb, line + 2);
+            } else if (line[0] == 'D') {
+                knowledge_drop_snapshot_ctx(kb, line + 2);
+            } else {
+                KnowledgeSnapshot* snapshot = knowledge_find_snapshot(kb, line + 2);
+                if (snapshot != NULL) {
+                    knowledge_restore(kb, snapshot);
+                }
+            }
+        } else if (line[0] == 'P' && line[1] == '\t') {
+            char *intent = line + 2;
+            char *entity = strchr(intent, '\t');
+            char *response = entity != NULL ? strchr(entity + 1, '\t') : NULL;
+            if (response == NULL) {
+                continue;
+            }
+            *entity++ = '\0';
+            *response++ = '\0';
+            knowledge_unescape(intent);
+            knowledge_unescape(entity);
+            knowledge_unescape(response);
+            knowledge_insert(kb, intent, entity, response);
+        } else {
+            continue;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+
+/*
+ * Determine whether this chatbot is a read-only follower.
+ *
+ * Input:
+ *   kb - the knowledge base, or NULL for the default one
+ *
+ * Returns:
+ *   1, if knowledge_follow() or knowledge_attach() has been called successfully
+ *   0, otherwise
+ */
+int knowledge_is_replica_ctx(KnowledgeBase *kb) {
+    kb = knowledge_base_of(kb);
+    return kb->replication_follower || kb->shared_reader;
+}
+
+
+/*
+ * Publish the knowledge base in shared memory, for other chatbot processes
+ * on this host to answer from with knowledge_attach(). Every later change
+ * is published too: in place while there is room, otherwise by publishing
+ * a whole new copy.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   name - the name to publish under, shared with the readers
+ *
+ * Returns:
+ *   KB_OK, if the knowledge base was published
+ *   KB_INVALID, if shared memory could not be created or this is a reader
+ *   KB_NOMEM, if the knowledge base did not fit in shared memory
+ */
+int knowledge_share_ctx(KnowledgeBase *kb, const char *name) {
+    kb = knowledge_base_of(kb);
+    if (name == NULL || kb->shared_reader) {
+        return KB_INVALID;
+    }
+
+    SharedKnowledge* sh = shared_publish(name);
+    if (sh == NULL) {
+        return KB_INVALID;
+    }
+
+    // Everything must be in memory to be copied
+    knowledge_prepare(kb);
+    knowledge_materialize(kb, NULL);
+
+    shared_close(kb->shared);
+    kb->shared = sh;
+    return knowledge_share_all(kb);
+}
+
+
+/*
+ * Become a read-only reader of a knowledge base published in shared memory
+ * by another process. Questions are then answered from the publisher's copy
+ * with knowledge_get() and knowledge_get_many() alone, without loading
+ * anything; the publisher's changes are seen as soon as they are made.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   name - the name the publisher gave to knowledge_share()
+ *
+ * Returns:
+ *   KB_OK, if the knowledge base was attached
+ *   KB_INVALID, if nothing is published under that name, or this is a
+ *               publisher, a leader or a follower
+ */
+int knowledge_attach_ctx(KnowledgeBase *kb, const char *name) {
+    kb = knowledge_base_of(kb);
+    if (name == NULL || kb->replication_log != NULL || (kb->shared != NULL && !kb->shared_reader)) {
+        return KB_INVALID;
+    }
+
+    SharedKnowledge* sh = shared_attach(name);
+    if (sh == NULL) {
+        return KB_INVALID;
+    }
+
+    shared_close(kb->shared);
+    kb->shared = sh;
+    kb->shared_reader = 1;
+    return KB_OK;
+}
+
+
+/*
+ * Publish a new copy of the whole knowledge base in shared memory, if this
+ * is a publisher. If it cannot be made, readers keep the previous one.
+ *
+ * Returns: KB_OK, or KB_NOMEM if the copy could not be made
+ */
+static int knowledge_share_all(KnowledgeBase *kb) {
+    if (kb->shared == NULL || kb->shared_reader) {
+        return KB_OK;
+    }
+
+    int count = 0;
+    size_t bytes = 0;
+    KnowledgeCursor cursor = { 0, -1 };
+    for (KnowledgeEntry* current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+        bytes += strlen(current->intent) + strlen(current->entity) + strlen(current->response) + 3;
+        count++;
+    }
+
+    if (shared_begin(kb->shared, count, bytes) != KB_OK) {
+        return KB_NOMEM;
+    }
+    cursor = (KnowledgeCursor){ 0, -1 };
+    for (KnowledgeEntry* current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+        shared_put(kb->shared, current->intent, current->entity, current->response);
+    }
+    return shared_commit(kb->shared);
+}
+
+
+/*
+ * Append a record to the replication log, if this is a leader.
+ *
+ * Input:
+ *   format - format string, as printf
+ *   ...    - as printf
+ */
+static void knowledge_log_record(KnowledgeBase *kb, const char *format, ...) {
+    if (kb->replication_log == NULL || kb->replication_follower) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(kb->replication_log, format, args);
+    va_end(args);
+    if (!kb->replication_batch) {
+        fflush(kb->replication_log);
+    }
+}
+
+
+/*
+ * Append a put to the replication log, if this is a leader. Each field is
+ * cut to the length the knowledge base keeps and escaped, so the record is
+ * always one line of at most MAX_LOG_RECORD characters.
+ */
+static void knowledge_log_put(KnowledgeBase *kb, const char *intent, const char *entity, const char *response) {
+    if (kb->replication_log == NULL || kb->replication_follower) {
+        return;
+    }
+
+    char escaped_intent[2 * MAX_INTENT];
+    char escaped_entity[2 * MAX_ENTITY];
+    char escaped_response[2 * MAX_RESPONSE];
+    knowledge_escape(escaped_intent, intent, MAX_INTENT);
+    knowledge_escape(escaped_entity, entity, MAX_ENTITY);
+    knowledge_escape(escaped_response, response, MAX_RESPONSE);
+    knowledge_log_record(kb, "P\t%s\t%s\t%s\n", escaped_intent, escaped_entity, escaped_response);
+}
+
+
+/*
+ * Escape a field of a replication log record.
+ *
+ * Input:
+ *   out - a buffer of at least 2 * n characters to receive the escaped field
+ *   in  - the field, of which at most n - 1 characters are kept
+ *   n   - the size of the field in the knowledge base
+ */
+static void knowledge_escape(char *out, const char *in, int n) {
+    for (int i = 0; i < n - 1 && in[i] != '\0'; i++) {
+        switch (in[i]) {
+        case '\t': *out++ = '\\'; *out++ = 't'; break;
+        case '\n': *out++ = '\\'; *out++ = 'n'; break;
+        case '\r': *out++ = '\\'; *out++ = 'r'; break;
+        case '\\': *out++ = '\\'; *out++ = '\\'; break;
+        default: *out++ = in[i];
+        }
+    }
+    *out = '\0';
+}
+
+
+/*
+ * Undo knowledge_escape() in place.
+ */
+static void knowledge_unescape(char *s) {
+    char* out = s;
+    for (; *s != '\0'; s++) {
+        if (*s == '\\' && s[1] != '\0') {
+            s++;
+            *out++ = *s == 't' ? '\t' : *s == 'n' ? '\n' : *s == 'r' ? '\r' : *s;
+        } else {
+            *out++ = *s;
+        }
+    }
+    *out = '\0';
+}
+
+
+/*
+ * Remember the current version of the knowledge base under a name, replacing
+ * any snapshot of the same name. This takes constant time: the snapshot
+ * shares every node with the live knowledge base, and keeps its own handle
+ * on any part of the default file not read yet rather than reading it.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   name - the name of the snapshot
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_NOMEM, if there was a memory allocation failure
+ *   KB_INVALID, if the name is empty
+ */
+int knowledge_snapshot_ctx(KnowledgeBase *kb, const char *name) {
+    kb = knowledge_base_of(kb);
+    if (name == NULL || name[0] == '\0') {
+        return KB_INVALID;
+    }
+
+    Sidecar* lazy = NULL;
+    if (kb->lazy != NULL && (lazy = sidecar_dup(kb->lazy)) == NULL) {
+        return KB_NOMEM;
+    }
+
+    KnowledgeSnapshot* snapshot = knowledge_find_snapshot(kb, name);
+    if (snapshot == NULL) {
+        snapshot = (KnowledgeSnapshot*)calloc(1, sizeof(KnowledgeSnapshot));
+        if (snapshot == NULL) {
+            sidecar_close(lazy);
+            return KB_NOMEM;
+        }
+        strncpy(snapshot->name, name, MAX_ENTITY - 1);
+        snapshot->name[MAX_ENTITY - 1] = '\0';
+        snapshot->next = kb->snapshots;
+        kb->snapshots = snapshot;
+    }
+
+    sidecar_close(snapshot->lazy);
+    snapshot->lazy = lazy;
+    snapshot->file_version = kb->file_version;
+    for (int i = 0; i < KB_SHARDS; i++) {
+        if (kb->shards[i] != NULL) {
+            kb->shards[i]->refs++;
+        }
+        knowledge_release_shard(snapshot->shards[i]);
+        snapshot->shards[i] = kb->shards[i];
+    }
+
+    char escaped[2 * MAX_ENTITY];
+    knowledge_escape(escaped, name, MAX_ENTITY);
+    knowledge_log_record(kb, "S\t%s\n", escaped);
+    return KB_OK;
+}
+
+
+/*
+ * Return the knowledge base to a named snapshot. The snapshot is kept, so it
+ * can be rolled back to again.
+ *
+ * Switching versions takes constant time; the search, spot and vector
+ * indexes are rebuilt the next time they are used. On disk, just the
+ * entries that differ between the two versions are appended to the delta
+ * file, unless the default file has been rewritten since the snapshot was
+ * taken, in which case it is rewritten again.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   name - the name of the snapshot
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_NOTFOUND, if there is no snapshot of that name
+ *   KB_INVALID, if this is a follower or the file could not be written
+ *   KB_NOMEM, if there was a memory allocation failure
+ */
+int knowledge_rollback_ctx(KnowledgeBase *kb, const char *name) {
+    kb = knowledge_base_of(kb);
+    if (name == NULL || knowledge_is_replica_ctx(kb)) {
+        return KB_INVALID;
+    }
+
+    KnowledgeSnapshot* snapshot = knowledge_find_snapshot(kb, name);
+    if (snapshot == NULL) {
+        return KB_NOTFOUND;
+    }
+
+    // The delta has to be worked out while both versions are still at hand
+    int saved = KB_INVALID;
+    if (snapshot->file_version == kb->file_version) {
+        saved = knowledge_save_rollback(kb, snapshot);
+    }
+
+    int result = knowledge_restore(kb, snapshot);
+    if (result != KB_OK) {
+        return result;
+    }
+    char escaped[2 * MAX_ENTITY];
+    knowledge_escape(escaped, name, MAX_ENTITY);
+    knowledge_log_record(kb, "B\t%s\n", escaped);
+    return saved == KB_OK ? KB_OK : knowledge_save_default(kb);
+}
+
+
+/*
+ * Forget a named snapshot, releasing whatever only it was holding on to.
+ *
+ * Input:
+ *   kb   - the knowledge base, or NULL for the default one
+ *   name - the name of the snapshot
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_NOTFOUND, if there is no snapshot of that name
+ *   KB_INVALID, if the name is NULL
+ */
+int knowledge_drop_snapshot_ctx(KnowledgeBase *kb, const char *name) {
+    kb = knowledge_base_of(kb);
+    if (name == NULL) {
+        return KB_INVALID;
+    }
+
+    for (KnowledgeSnapshot** link = &kb->snapshots; *link != NULL; link = &(*link)->next) {
+        if (strcasecmp((*link)->name, name) == 0) {
+            KnowledgeSnapshot* snapshot = *link;
+            *link = snapshot->next;
+            knowledge_free_snapshot(snapshot);
+
+            char escaped[2 * MAX_ENTITY];
+            knowledge_escape(escaped, name, MAX_ENTITY);
+            knowledge_log_record(kb, "D\t%s\n", escaped);
+            return KB_OK;
+        }
+    }
+    return KB_NOTFOUND;
+}
+
+
+/*
+ * Free a snapshot that is no longer in any list.
+ */
+static void knowledge_free_snapshot(KnowledgeSnapshot *snapshot) {
+    for (int i = 0; i < KB_SHARDS; i++) {
+        knowledge_release_shard(snapshot->shards[i]);
+    }
+    sidecar_close(snapshot->lazy);
+    free(snapshot);
+}
+
+
+/*
+ * Copy a response found in the default file, as sidecar_find() reports it,
+ * punctuated as it would be once loaded.
+ */
+static void knowledge_copy_found(void *arg, const char *intent, const char *entity, const char *response) {
+    (void)intent;
+    (void)entity;
+    knowledge_punctuate((char*)arg, response, (int)strlen(response));
+}
+
+
+/*
+ * Look up what one version of the knowledge base says about an entity.
+ *
+ * Input:
+ *   shard    - the version's table for the entity's shard, or NULL
+ *   lazy     - the version's handle on the default file, or NULL
+ *   response - a buffer of MAX_RESPONSE characters to receive the response
+ *
+ * Returns: 1 if the version knows the entity, 0 if not
+ */
+static int knowledge_version_get(KnowledgeBase *kb, KnowledgeShard *shard, Sidecar *lazy, const char *intent, const char *entity, char *response) {
+    unsigned long hash = knowledge_hash(entity);
+    KnowledgeEntry* entry = shard != NULL ? knowledge_probe(shard, hash, knowledge_intent_id(kb, intent, 0), entity)->entry : NULL;
+    if (entry != NULL) {
+        strcpy(response, entry->response);
+        return 1;
+    }
+    return lazy != NULL && sidecar_find(lazy, intent, entity, knowledge_copy_found, response) == KB_OK;
+}
+
+
+/*
+ * Append to the delta file whatever turns the live knowledge base into a
+ * snapshot of it: the snapshot's version of each entry that differs, and
+ * the entities only the live one knows, on lines of their own. Shards that
+ * the two still share have not changed and are skipped, so the work depends
+ * on how much has changed rather than on the size of the knowledge base.
+ *
+ * The live knowledge base must match its files, and both versions must be
+ * based on the same default file; entries neither has read from it yet are
+ * then the same in both.
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the delta file could not be written
+ */
+static int knowledge_save_rollback(KnowledgeBase *kb, KnowledgeSnapshot *snapshot) {
+    FILE* f = fopen(kb->delta_path, "a");
+    if (f == NULL) {
+        return KB_INVALID;
+    }
+
+    const char* section = NULL;
+    char response[MAX_RESPONSE];
+    for (int i = 0; i < KB_SHARDS; i++) {
+        KnowledgeShard* versions[2] = { snapshot->shards[i], kb->shards[i] };
+        if (versions[0] == versions[1]) {
+            continue;
+        }
+
+        // First the snapshot's entries, then the live entries it lacks
+        for (int v = 0; v < 2; v++) {
+            if (versions[v] == NULL) {
+                continue;
+            }
+            for (int j = 0; j < versions[v]->capacity; j++) {
+                KnowledgeEntry* entry = versions[v]->slots[j].entry;
+                if (entry == NULL) {
+                    continue;
+                }
+
+                const char* want;
+                if (v == 0) {
+                    if (knowledge_version_get(kb, versions[1], kb->lazy, entry->intent, entry->entity, response) &&
+                        strcmp(response, entry->response) == 0) {
+                        continue;
+                    }
+                    want = entry->response;
+                } else {
+                    if (versions[0] != NULL && knowledge_probe(versions[0], knowledge_hash(entry->entity), versions[1]->slots[j].intent, entry->entity)->entry != NULL) {
+                        continue;
+                    }
+                    int known = knowledge_version_get(kb, NULL, snapshot->lazy, entry->intent, entry->entity, response);
+                    if (known && strcmp(response, entry->response) == 0) {
+                        continue;
+                    }
+                    want = known ? response : NULL;
+                }
+
+                if (section == NULL || strcasecmp(section, entry->intent) != 0) {
+                    fprintf(f, "[%s]\n", entry->intent);
+                    section = entry->intent;
+                }
+                if (want != NULL) {
+                    fprintf(f, "%s=%s\n", entry->entity, want);
+                } else {
+                    fprintf(f, "%s\n", entry->entity);
+                }
+                kb->delta_count++;
+            }
+        }
+    }
+
+    return fclose(f) == 0 ? KB_OK : KB_INVALID;
+}
+
+
+/*
+ * Find a snapshot by name.
+ *
+ * Returns: the snapshot, or NULL if there is none
+ */
+static KnowledgeSnapshot* knowledge_find_snapshot(KnowledgeBase *kb, const char *name) {
+    for (KnowledgeSnapshot* snapshot = kb->snapshots; snapshot != NULL; snapshot = snapshot->next) {
+        if (strcasecmp(snapshot->name, name) == 0) {
+            return snapshot;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Make a snapshot the live version of the knowledge base. The indexes are
+ * only marked out of date; they are rebuilt when next used.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int knowledge_restore(KnowledgeBase *kb, KnowledgeSnapshot *snapshot) {
+    Sidecar* lazy = NULL;
+    if (snapshot->lazy != NULL && (lazy = sidecar_dup(snapshot->lazy)) == NULL) {
+        return KB_NOMEM;
+    }
+
+    for (int i = 0; i < KB_SHARDS; i++) {
+        if (snapshot->shards[i] != NULL) {
+            snapshot->shards[i]->refs++;
+        }
+        knowledge_release_shard(kb->shards[i]);
+        kb->shards[i] = snapshot->shards[i];
+    }
+    knowledge_discard_lazy(kb);
+    kb->lazy = lazy;
+    knowledge_clear_dirty(kb);
+    kb->indexes_stale = 1;
+
+    // A shared copy has to hold everything
+    if (kb->shared != NULL && !kb->shared_reader) {
+        knowledge_materialize(kb, NULL);
+        knowledge_share_all(kb);
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Answer a question by full-text search when there is no entry for its exact
+ * entity: the best BM25 match among the entries for the same question word.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   intent   - the question word
+ *   query    - the words of the question
+ *   response - a buffer to receive the response
+ *   n        - the maximum number of characters to write to the response buffer
+ *
+ * Returns:
+ *   KB_OK, if a matching entry was found (its response is copied to the response buffer)
+ *   KB_NOTFOUND, if no entry matches the query well enough (see search_query())
+ *   KB_INVALID, if the inputs are invalid
+ */
+int knowledge_search_ctx(KnowledgeBase *kb, const char *intent, const char *query, char *response, int n) {
+    kb = knowledge_base_of(kb);
+    if (intent == NULL || query == NULL || response == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+    knowledge_prepare(kb);
+    knowledge_materialize(kb, intent);
+    knowledge_refresh_indexes(kb);
+
+    SearchHit hit;
+    if (search_query(kb->index, intent, query, &hit, 1) == 0) {
+        return KB_NOTFOUND;
+    }
+
+    KnowledgeEntry* entry = knowledge_find(kb, knowledge_hash(hit.entity), intent, hit.entity);
+    if (entry == NULL) {
+        return KB_NOTFOUND;
+    }
+
+    strncpy(response, entry->response, n - 1);
+    response[n - 1] = '\0';
+    return KB_OK;
+}
+
+
+/*
+ * Find the longest known entity mentioned anywhere in a line of free text,
+ * such as "do you know about ICT1503C and SIT".
+ *
+ * Input:
+ *   kb     - the knowledge base, or NULL for the default one
+ *   intent - the question word
+ *   text   - the text
+ *   entity - a buffer to receive the entity, as written in the text
+ *   n      - the maximum number of characters to write to the entity buffer
+ *
+ * Returns:
+ *   KB_OK, if an entity was found (its response can be got with knowledge_get())
+ *   KB_NOTFOUND, if the text mentions no entity known under the intent
+ *   KB_INVALID, if the inputs are invalid
+ */
+int knowledge_spot_ctx(KnowledgeBase *kb, const char *intent, const char *text, char *entity, int n) {
+    kb = knowledge_base_of(kb);
+    if (intent == NULL || text == NULL || entity == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+    knowledge_prepare(kb);
+    knowledge_materialize(kb, intent);
+    knowledge_refresh_indexes(kb);
+
+    if (spot_find(kb->spotter, intent, text, entity, n) != KB_OK) {
+        return KB_NOTFOUND;
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Answer a question by meaning when neither its entity nor its words match
+ * an entry: the entry for the same question word whose entity and response
+ * are most similar to the question, if it is similar enough. A question
+ * that names the entity in part, as "where do ICT students study" does "ICT
+ * Cluster", needs less similarity than one that only shares words with the
+ * response, as "what is a computer" does. The entries are embedded the first
+ * time this is called.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   intent   - the question word
+ *   query    - the words of the question
+ *   response - a buffer to receive the response
+ *   n        - the maximum number of characters to write to the response buffer
+ *
+ * Returns:
+ *   KB_OK, if a similar enough entry was found (its response is copied to the response buffer)
+ *   KB_NOTFOUND, if no entry is similar enough
+ *   KB_INVALID, if the inputs are invalid
+ *   KB_NOMEM, if there was a memory allocation failure
+ */
+int knowledge_similar_ctx(KnowledgeBase *kb, const char *intent, const char *query, char *response, int n) {
+    kb = knowledge_base_of(kb);
+    if (intent == NULL || query == NULL || response == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+    knowledge_prepare(kb);
+    knowledge_materialize(kb, intent);
+
+    if (kb->vectors == NULL) {
+        kb->vectors = vector_create(kb->vectors_ivf);
+        if (kb->vectors == NULL) {
+            return KB_NOMEM;
+        }
+        knowledge_reindex(kb);
+    }
+    knowledge_refresh_indexes(kb);
+
+    SearchHit hit;
+    if (vector_query(kb->vectors, intent, query, &hit) == 0 || hit.score < KB_SIMILAR_NAMED ||
+        (hit.score < KB_SIMILAR_THRESHOLD && !vector_names(query, hit.entity))) {
+        return KB_NOTFOUND;
+    }
+
+    KnowledgeEntry* entry = knowledge_find(kb, knowledge_hash(hit.entity), intent, hit.entity);
+    if (entry == NULL) {
+        return KB_NOTFOUND;
+    }
+
+    strncpy(response, entry->response, n - 1);
+    response[n - 1] = '\0';
+    return KB_OK;
+}
+
+
+/*
+ * Choose how knowledge_similar() searches intents with many entries: through
+ * inverted lists, which is much faster but may miss the most similar entry,
+ * or by comparing every entry (the default).
+ *
+ * Input:
+ *   kb          - the knowledge base, or NULL for the default one
+ *   approximate - 1 to use inverted lists, 0 to compare every entry
+ */
+void knowledge_set_approximate_ctx(KnowledgeBase *kb, int approximate) {
+    kb = knowledge_base_of(kb);
+    kb->vectors_ivf = approximate != 0;
+    vector_set_ivf(kb->vectors, kb->vectors_ivf);
+}
+
+
+/*
+ * Count a question that could not be answered. The questions counted most
+ * often are also written to "path.misses" on the first miss, then every
+ * KB_MISS_DUMP_INTERVAL seconds at most, and finally by
+ * knowledge_save_misses(), one per line as count, intent, entity and the
+ * question as asked separated by tabs. A question is forgotten once
+ * knowledge_put() learns its answer.
+ *
+ * Input:
+ *   kb       - the knowledge base, or NULL for the default one
+ *   intent   - the question word
+ *   entity   - the entity asked about
+ *   question - the question as asked, or NULL to list it as intent and entity
+ */
+void knowledge_miss_ctx(KnowledgeBase *kb, const char *intent, const char *entity, const char *question) {
+    kb = knowledge_base_of(kb);
+    if (intent == NULL || entity == NULL) {
+        return;
+    }
+
+    if (kb->misses == NULL) {
+        kb->misses = misses_create();
+        if (kb->misses == NULL) {
+            return;
+        }
+    }
+    misses_add(kb->misses, intent, entity, question);
+    kb->misses_changed = 1;
+
+    if (time(NULL) - kb->misses_dumped >= KB_MISS_DUMP_INTERVAL) {
+        knowledge_save_misses_ctx(kb);
+    }
+}
+
+
+/*
+ * Write the unanswered questions counted most often to "path.misses", as
+ * knowledge_miss() does, if they have changed since they were last written.
+ * knowledge_destroy() does this itself; a program using the default
+ * knowledge base calls it before exiting.
+ *
+ * Input:
+ *   kb - the knowledge base, or NULL for the default one
+ */
+void knowledge_save_misses_ctx(KnowledgeBase *kb) {
+    kb = knowledge_base_of(kb);
+    if (kb->misses == NULL || !kb->misses_changed) {
+        return;
+    }
+    kb->misses_dumped = time(NULL);
+    kb->misses_changed = 0;
+
+    char path[KB_MAX_PATH + 8];
+    snprintf(path, sizeof(path), "%s.misses", kb->path);
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        return;
+    }
+
+    MissCount top[KB_MISS_DUMP_COUNT];
+    int count = misses_top(kb->misses, top, KB_MISS_DUMP_COUNT);
+    for (int i = 0; i < count; i++) {
+        fprintf(f, "%lu\t%s\t%s\t%s\n", top[i].count, top[i].intent, top[i].entity, top[i].question);
+    }
+    fclose(f);
+}
+
+
+/*
+ * List the unanswered questions counted most often by knowledge_miss().
+ * The counts may be slight overestimates.
+ *
+ * Input:
+ *   kb  - the knowledge base, or NULL for the default one
+ *   top - receives the questions, most counted first
+ *   k   - the most questions to list
+ *
+ * Returns: the number of questions listed
+ */
+int knowledge_top_misses_ctx(KnowledgeBase *kb, MissCount *top, int k) {
+    kb = knowledge_base_of(kb);
+    return misses_top(kb->misses, top, k);
+}
+
+
+/*
+ * Add a new or replaced entry to the full-text index, the entity spotter
+ * and the embeddings (if built). All are only aids to answering, so running
+ * out of memory here is not an error.
+ */
+static void knowledge_index_entry(KnowledgeBase *kb, const char *intent, const char *entity, const char *response) {
+    if (kb->shared != NULL && !kb->shared_reader && shared_put(kb->shared, intent, entity, response) == KB_NOMEM) {
+        knowledge_share_all(kb);
+    }
+
+    // Indexes waiting to be rebuilt will pick the entry up then
+    if (kb->indexes_stale) {
+        return;
+    }
+
+    if (kb->spotter == NULL) {
+        kb->spotter = spot_create();
+    }
+    spot_add(kb->spotter, intent, entity);
+    vector_add(kb->vectors, intent, entity, response);
+
+    if (kb->index == NULL) {
+        kb->index = search_create();
+        if (kb->index == NULL) {
+            return;
+        }
+    }
+
+    search_add(kb->index, intent, entity, response);
+    if (search_stale(kb->index)) {
+        knowledge_reindex(kb);
+    }
+}
+
+
+/*
+ * Rebuild the full-text index, the entity spotter and the embeddings (those
+ * that have been built) from the live knowledge base.
+ */
+static void knowledge_reindex(KnowledgeBase *kb) {
+    kb->indexes_stale = 0;
+    if (kb->index == NULL && kb->spotter == NULL && kb->vectors == NULL) {
+        return;
+    }
+
+    search_clear(kb->index);
+    spot_clear(kb->spotter);
+    vector_clear(kb->vectors);
+    KnowledgeCursor cursor = { 0, -1 };
+    for (KnowledgeEntry* current = knowledge_next(kb, &cursor); current != NULL; current = knowledge_next(kb, &cursor)) {
+        if (kb->index != NULL) {
+            search_add(kb->index, current->intent, current->entity, current->response);
+        }
+        spot_add(kb->spotter, current->intent, current->entity);
+        vector_add(kb->vectors, current->intent, current->entity, current->response);
+    }
+}
+
+
+/*
+ * Rebuild the search, spot and vector indexes if something has left them
+ * out of date, such as a rollback or a forgotten entry.
+ */
+static void knowledge_refresh_indexes(KnowledgeBase *kb) {
+    if (!kb->indexes_stale) {
+        return;
+    }
+
+    if (kb->index == NULL) {
+        kb->index = search_create();
+    }
+    if (kb->spotter == NULL) {
+        kb->spotter = spot_create();
+    }
+    knowledge_reindex(kb);
+}
+
+
+/*
+ * The functions below work on the default knowledge base; see the
+ * knowledge_*_ctx() function of the same name.
+ */
+int knowledge_get(const char *intent, const char *entity, char *response, int n) {
+    return knowledge_get_ctx(NULL, intent, entity, response, n);
+}
+
+int knowledge_view(const char *intent, const char *entity, const char **response, int *len) {
+    return knowledge_view_ctx(NULL, intent, entity, response, len);
+}
+
+int knowledge_get_many(const KnowledgeKey *keys, int count, char *responses[], int n, int results[]) {
+    return knowledge_get_many_ctx(NULL, keys, count, responses, n, results);
+}
+
+int knowledge_put(const char *intent, const char *entity, const char *response) {
+    return knowledge_put_ctx(NULL, intent, entity, response);
+}
+
+void knowledge_reset() {
+    knowledge_reset_ctx(NULL);
+}
+
+int knowledge_read(FILE *f) {
+    return knowledge_read_ctx(NULL, f);
+}
+
+void knowledge_write(FILE *f) {
+    knowledge_write_ctx(NULL, f);
+}
+
+int knowledge_erase() {
+    return knowledge_erase_ctx(NULL);
+}
+
+int knowledge_publish(const char *path) {
+    return knowledge_publish_ctx(NULL, path);
+}
+
+int knowledge_follow(const char *path, const char *snapshot) {
+    return knowledge_follow_ctx(NULL, path, snapshot);
+}
+
+int knowledge_replicate() {
+    return knowledge_replicate_ctx(NULL);
+}
+
+int knowledge_is_replica() {
+    return knowledge_is_replica_ctx(NULL);
+}
+
+int knowledge_share(const char *name) {
+    return knowledge_share_ctx(NULL, name);
+}
+
+int knowledge_attach(const char *name) {
+    return knowledge_attach_ctx(NULL, name);
+}
+
+int knowledge_snapshot(const char *name) {
+    return knowledge_snapshot_ctx(NULL, name);
+}
+
+int knowledge_rollback(const char *name) {
+    return knowledge_rollback_ctx(NULL, name);
+}
+
+int knowledge_drop_snapshot(const char *name) {
+    return knowledge_drop_snapshot_ctx(NULL, name);
+}
+
+int knowledge_search(const char *intent, const char *query, char *response, int n) {
+    return knowledge_search_ctx(NULL, intent, query, response, n);
+}
+
+int knowledge_spot(const char *intent, const char *text, char *entity, int n) {
+    return knowledge_spot_ctx(NULL, intent, text, entity, n);
+}
+
+int knowledge_similar(const char *intent, const char *query, char *response, int n) {
+    return knowledge_similar_ctx(NULL, intent, query, response, n);
+}
+
+void knowledge_set_approximate(int approximate) {
+    knowledge_set_approximate_ctx(NULL, approximate);
+}
+
+void knowledge_miss(const char *intent, const char *entity, const char *question) {
+    knowledge_miss_ctx(NULL, intent, entity, question);
+}
+
+int knowledge_top_misses(MissCount *top, int k) {
+    return knowledge_top_misses_ctx(NULL, top, k);
+}
+
+void knowledge_save_misses() {
+    knowledge_save_misses_ctx(NULL);
+}
@@ -17,7 +17,8 @@
  */
 
 /*
- * This file implements the main loop, including dividing input into words.
+ * This file implements the main loop. Input is divided into words by
+ * split_words() in chatbot.c.
  *
  * You should not need to modify this file. You may invoke its functions if you 
  * like, however.
@@ -29,10 +30,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
 #include "chat1503C.h"
 
-/* word delimiters */
-const char *delimiters = " ?\t\n";
+/* size of the stdio buffers used in pipe mode */
+#define PIPE_BUFFER  (1 << 16)
+
+/* set to 1 when driven by a script: no prompts, buffered I/O, bare responses */
+static int pipe_mode = 0;
 
 
 /*
@@ -44,81 +55,138 @@ int main(int argc, char *argv[]) {
 	int inc;                    /* the number of words in the user input */
 	char *inv[MAX_INPUT];       /* pointers to the beginning of each word of input */
 	char output[MAX_RESPONSE];  /* the chatbot's output */
-	int len;                    /* length of a word */
 	int done = 0;               /* set to 1 to end the main loop */
+	const char *publish = NULL; /* replication log to publish to, if a leader */
+	const char *follow = NULL;  /* replication log to follow, if a replica */
+	const char *snapshot = NULL;/* snapshot a replica bootstraps from */
+	const char *share = NULL;   /* shared memory to publish the knowledge base in */
+	const char *attach = NULL;  /* shared memory to answer from, if a reader */
+	const char *log = NULL;     /* file to keep a transcript in */
+	int log_policy = TRANSCRIPT_DROP;
+	long log_rotate = 0;        /* size to rotate the transcript at, or 0 */
+	TranscriptLog *transcript = NULL;
+
+	/* parse the command line */
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-publish") == 0 && i + 1 < argc)
+			publish = argv[++i];
+		else if (strcmp(argv[i], "-follow") == 0 && i + 1 < argc)
+			follow = argv[++i];
+		else if (strcmp(argv[i], "-snapshot") == 0 && i + 1 < argc)
+			snapshot = argv[++i];
+		else if (strcmp(argv[i], "-share") == 0 && i + 1 < argc)
+			share = argv[++i];
+		else if (strcmp(argv[i], "-attach") == 0 && i + 1 < argc)
+			attach = argv[++i];
+		else if (strcmp(argv[i], "-transcript") == 0 && i + 1 < argc)
+			log = argv[++i];
+		else if (strcmp(argv[i], "-transcript-block") == 0)
+			log_policy = TRANSCRIPT_BLOCK;
+		else if (strcmp(argv[i], "-transcript-rotate") == 0 && i + 1 < argc)
+			log_rotate = atol(argv[++i]);
+		else if (strcmp(argv[i], "-pipe") == 0)
+			pipe_mode = 1;
+		else if (strcmp(argv[i], "-approximate") == 0)
+			knowledge_set_approximate(1);
+		else {
+			fprintf(stderr, "Usage: %s [-pipe] [-approximate] [-publish log | -follow log [-snapshot file]] [-share name | -attach name]\n"
+			        "       [-transcript file [-transcript-block] [-transcript-rotate bytes]]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	/* input that is not a terminal comes from a script */
+	if (!isatty(fileno(stdin)))
+		pipe_mode = 1;
+
+	/* in pipe mode, read and write in large blocks rather than per line */
+	if (pipe_mode) {
+		setvbuf(stdin, NULL, _IOFBF, PIPE_BUFFER);
+		setvbuf(stdout, NULL, _IOFBF, PIPE_BUFFER);
+	}
 
 	/* initialise the chatbot */
-	inv[0] = "reset";
-	inv[1] = NULL;
-	chatbot_do_reset(1, inv, output, MAX_RESPONSE);
+	if (publish != NULL && knowledge_publish(publish) != KB_OK) {
+		fprintf(stderr, "Cannot publish to \"%s\".\n", publish);
+		return 1;
+	}
+	if (follow != NULL) {
+		if (knowledge_follow(follow, snapshot) != KB_OK) {
+			fprintf(stderr, "Cannot follow \"%s\".\n", follow);
+			return 1;
+		}
+	} else if (attach != NULL) {
+		if (knowledge_attach(attach) != KB_OK) {
+			fprintf(stderr, "Cannot attach to \"%s\".\n", attach);
+			return 1;
+		}
+	} else {
+		inv[0] = "reset";
+		inv[1] = NULL;
+		chatbot_do_reset(1, inv, output, MAX_RESPONSE);
+	}
+	if (share != NULL && knowledge_share(share) != KB_OK) {
+		fprintf(stderr, "Cannot share \"%s\".\n", share);
+		return 1;
+	}
+	if (log != NULL && (transcript = transcript_open(log, log_policy, log_rotate)) == NULL) {
+		fprintf(stderr, "Cannot open transcript \"%s\".\n", log);
+		return 1;
+	}
 
 	/* print a welcome message */
-	printf("%s: Hello, I'm %s.\n", chatbot_botname(), chatbot_botname());
+	if (!pipe_mode)
+		printf("%s: Hello, I'm %s.\n", chatbot_botname(), chatbot_botname());
 
 	/* main command loop */
 	do {
 
 		do {
 			/* read the line */
-			printf("%s: ", chatbot_username());
-			fgets(input, MAX_INPUT, stdin);
-
-			/* split it into words */
 			inc = 0;
-			inv[inc] = strtok(input, delimiters);
-			while (inv[inc] != NULL) {
-
-				/* remove trailing punctuation */
-				len = strlen(inv[inc]);
-				while (len > 0 && ispunct(inv[inc][len - 1])) {
-					inv[inc][len - 1] = '\0';
-					len--;
-				}
-
-				/* go to the next word */
-				inc++;
-				inv[inc] = strtok(NULL, delimiters);
+			if (!pipe_mode)
+				printf("%s: ", chatbot_username());
+			if (fgets(input, MAX_INPUT, stdin) == NULL)
+				break;
+
+			/* record it before it is taken apart */
+			if (transcript != NULL) {
+				input[strcspn(input, "\r\n")] = '\0';
+				if (input[0] != '\0')
+					transcript_log(transcript, chatbot_username(), input);
 			}
+
+			/* split it into words */
+			inc = split_words(input, inv, MAX_INPUT);
 		} while (inc < 1);
 
+		/* stop at the end of the input */
+		if (inc < 1)
+			break;
+
 		/* invoke the chatbot */
 		done = chatbot_main(inc, inv, output, MAX_RESPONSE);
-		printf("%s: %s\n", chatbot_botname(), output);
+		if (transcript != NULL)
+			transcript_log(transcript, chatbot_botname(), output);
+		if (pipe_mode) {
+			fputs(output, stdout);
+			putchar('\n');
+		} else {
+			printf("%s: %s\n", chatbot_botname(), output);
+		}
 
 	} while (!done);
 
-	return 0;
-}
-
+	/* keep the unanswered questions of this session */
+	knowledge_save_misses();
 
-/*
- * Utility function for comparing string case-insensitively.
- *
- * Input:
- *   token1 - the first token
- *   token2 - the second token
- *
- * Returns:
- *   as strcmp()
- */
-int compare_token(const char *token1, const char *token2) {
-
-	int i = 0;
-	while (token1[i] != '\0' && token2[i] != '\0') {
-		if (toupper(token1[i]) < toupper(token2[i]))
-			return -1;
-		else if (toupper(token1[i]) > toupper(token2[i]))
-			return 1;
-		i++;
+	fflush(stdout);
+	if (transcript != NULL) {
+		if (transcript_dropped(transcript) > 0)
+			fprintf(stderr, "%lu lines were dropped from the transcript.\n", transcript_dropped(transcript));
+		transcript_close(transcript);
 	}
-
-	if (token1[i] == '\0' && token2[i] == '\0')
-		return 0;
-	else if (token1[i] == '\0')
-		return -1;
-	else
-		return 1;
-
+	return 0;
 }
 
 
@@ -133,17 +201,20 @@ int compare_token(const char *token1, const char *token2) {
  */
 void prompt_user(char *buf, int n, const char *format, ...) {
 
-	/* print the prompt */
-	va_list args;
-	va_start(args, format);
-	printf("%s: ", chatbot_botname());
-	vprintf(format, args);
-	printf(" ");
-	va_end(args);
-	printf("\n%s: ", chatbot_username());
+	/* print the prompt, unless a script is driving us */
+	if (!pipe_mode) {
+		va_list args;
+		va_start(args, format);
+		printf("%s: ", chatbot_botname());
+		vprintf(format, args);
+		printf(" ");
+		va_end(args);
+		printf("\n%s: ", chatbot_username());
+	}
 
 	/* get the response from the user */
-	fgets(buf, n, stdin);
+	if (fgets(buf, n, stdin) == NULL)
+		buf[0] = '\0';
 	char *nl = strchr(buf, '\n');
 	if (nl != NULL)
 		*nl = '\0';
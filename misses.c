@@ -0,0 +1,335 @@
+/* -----------------------------------------------------------------------------
+   Chatbot unanswered question tracking.
+   Team ID:
+   Team Name:
+   Filename:     misses.c
+   Version:      2024-1.0
+   Description:  C source for the unanswered question tracker in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file keeps track of the questions asked most often that the chatbot
+ * could not answer, in a fixed amount of memory however many are asked.
+ *
+ * misses_create() makes an empty tracker.
+ * misses_add() counts one unanswered question.
+ * misses_remove() forgets a question once it has been answered.
+ * misses_top() lists the questions counted most often.
+ * misses_clear() forgets every question.
+ * misses_destroy() frees the tracker.
+ *
+ * Every question is counted in a count-min sketch: MISS_DEPTH rows of
+ * MISS_WIDTH counters, each row indexed by a different hash of the question.
+ * A question's count is the smallest of its counters, which can only
+ * overestimate, and only by the questions sharing all of those counters.
+ * Only the counters holding that smallest value are incremented (the
+ * "conservative update"), which keeps the overestimates down.
+ *
+ * The MISS_TOP questions with the highest counts are kept by name in a
+ * min-heap. A question that is not in the heap replaces the least counted
+ * one once its own count overtakes it (as in the Space-Saving algorithm).
+ */
+
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chat1503C.h"
+
+/* the number of rows and the number of counters per row of the sketch (a power of two) */
+#define MISS_DEPTH 4
+#define MISS_WIDTH 2048
+
+/* the number of questions kept by name */
+#define MISS_TOP   32
+
+
+typedef struct MissCandidate {
+    unsigned long hash;             // misses_hash() of the question
+    MissCount miss;
+} MissCandidate;
+
+struct MissTracker {
+    unsigned int counters[MISS_DEPTH][MISS_WIDTH];
+    MissCandidate top[MISS_TOP];    // a min-heap on miss.count
+    int top_count;
+};
+
+
+/*
+ * Hash a question case-insensitively (64-bit FNV-1a).
+ */
+static unsigned long long misses_hash(const char *intent, const char *entity) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (const char* p = intent; *p != '\0'; p++) {
+        hash ^= (unsigned char)toupper((unsigned char)*p);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= '\t';
+    hash *= 1099511628211ULL;
+    for (const char* p = entity; *p != '\0'; p++) {
+        hash ^= (unsigned char)toupper((unsigned char)*p);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+/*
+ * Restore the heap property below a candidate whose count has grown.
+ */
+static void misses_sift_down(MissTracker *mt, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1, right = 2 * i + 2;
+        if (left < mt->top_count && mt->top[left].miss.count < mt->top[smallest].miss.count) {
+            smallest = left;
+        }
+        if (right < mt->top_count && mt->top[right].miss.count < mt->top[smallest].miss.count) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+
+        MissCandidate swap = mt->top[i];
+        mt->top[i] = mt->top[smallest];
+        mt->top[smallest] = swap;
+        i = smallest;
+    }
+}
+
+
+/*
+ * Restore the heap property above a newly added candidate.
+ */
+static void misses_sift_up(MissTracker *mt, int i) {
+    while (i > 0 && mt->top[i].miss.count < mt->top[(i - 1) / 2].miss.count) {
+        MissCandidate swap = mt->top[i];
+        mt->top[i] = mt->top[(i - 1) / 2];
+        mt->top[(i - 1) / 2] = swap;
+        i = (i - 1) / 2;
+    }
+}
+
+
+/*
+ * Fill in a candidate for a question, as asked if the question is given.
+ */
+static void misses_set(MissCandidate *candidate, unsigned long hash, const char *intent, const char *entity,
+                       const char *question, unsigned long count) {
+    candidate->hash = hash;
+    strncpy(candidate->miss.intent, intent, MAX_INTENT - 1);
+    candidate->miss.intent[MAX_INTENT - 1] = '\0';
+    strncpy(candidate->miss.entity, entity, MAX_ENTITY - 1);
+    candidate->miss.entity[MAX_ENTITY - 1] = '\0';
+    if (question != NULL) {
+        strncpy(candidate->miss.question, question, MAX_INPUT - 1);
+        candidate->miss.question[MAX_INPUT - 1] = '\0';
+    } else {
+        snprintf(candidate->miss.question, MAX_INPUT, "%s %s", intent, entity);
+    }
+    candidate->miss.count = count;
+}
+
+
+/*
+ * Find the counters of a question in each row of the sketch. Row i uses the
+ * hash h1 + i * h2.
+ */
+static void misses_counters(MissTracker *mt, unsigned long long hash, unsigned int *counter[MISS_DEPTH]) {
+    unsigned int h1 = (unsigned int)hash, h2 = (unsigned int)(hash >> 32) | 1;
+    for (int i = 0; i < MISS_DEPTH; i++) {
+        counter[i] = &mt->counters[i][(h1 + i * h2) & (MISS_WIDTH - 1)];
+    }
+}
+
+
+/*
+ * Find a question in the heap.
+ *
+ * Returns: its position, or -1 if it is not there
+ */
+static int misses_find(const MissTracker *mt, unsigned long hash, const char *intent, const char *entity) {
+    for (int i = 0; i < mt->top_count; i++) {
+        const MissCandidate* candidate = &mt->top[i];
+        if (candidate->hash == hash && strcasecmp(candidate->miss.entity, entity) == 0 &&
+            strcasecmp(candidate->miss.intent, intent) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Create an empty tracker. Its size is fixed.
+ *
+ * Returns: the tracker, or NULL if there was a memory allocation failure
+ */
+MissTracker *misses_create() {
+    return (MissTracker*)calloc(1, sizeof(MissTracker));
+}
+
+
+/*
+ * Forget every question.
+ */
+void misses_clear(MissTracker *mt) {
+    if (mt != NULL) {
+        memset(mt, 0, sizeof(MissTracker));
+    }
+}
+
+
+/*
+ * Free a tracker.
+ */
+void misses_destroy(MissTracker *mt) {
+    free(mt);
+}
+
+
+/*
+ * Count one question that could not be answered. The question is listed as
+ * it was first asked; questions differing only in wording, such as "who is"
+ * and "who was", are counted together.
+ *
+ * Input:
+ *   mt       - the tracker
+ *   intent   - the question word
+ *   entity   - the entity asked about
+ *   question - the question as asked, or NULL to list it as intent and entity
+ */
+void misses_add(MissTracker *mt, const char *intent, const char *entity, const char *question) {
+    if (mt == NULL || intent == NULL || entity == NULL) {
+        return;
+    }
+
+    unsigned long long hash = misses_hash(intent, entity);
+    unsigned int* counter[MISS_DEPTH];
+    misses_counters(mt, hash, counter);
+    unsigned int least = ~0U;
+    for (int i = 0; i < MISS_DEPTH; i++) {
+        if (*counter[i] < least) {
+            least = *counter[i];
+        }
+    }
+    if (least == ~0U) {
+        return;
+    }
+    for (int i = 0; i < MISS_DEPTH; i++) {
+        if (*counter[i] == least) {
+            (*counter[i])++;
+        }
+    }
+    unsigned long count = least + 1;
+
+    // Keep the heap up to date if the question is in it
+    int i = misses_find(mt, (unsigned long)hash, intent, entity);
+    if (i >= 0) {
+        mt->top[i].miss.count = count;
+        misses_sift_down(mt, i);
+        return;
+    }
+
+    if (mt->top_count < MISS_TOP) {
+        misses_set(&mt->top[mt->top_count], (unsigned long)hash, intent, entity, question, count);
+        misses_sift_up(mt, mt->top_count++);
+    } else if (count > mt->top[0].miss.count) {
+        misses_set(&mt->top[0], (unsigned long)hash, intent, entity, question, count);
+        misses_sift_down(mt, 0);
+    }
+}
+
+
+/*
+ * Forget a question that has now been answered. Its count is taken back off
+ * its counters, so it starts again from nothing if it is ever missed again.
+ * Other questions sharing one of those counters may be undercounted after
+ * this, but only by the times this question was asked.
+ *
+ * Input:
+ *   mt     - the tracker
+ *   intent - the question word
+ *   entity - the entity asked about
+ */
+void misses_remove(MissTracker *mt, const char *intent, const char *entity) {
+    if (mt == NULL || intent == NULL || entity == NULL) {
+        return;
+    }
+
+    unsigned long long hash = misses_hash(intent, entity);
+    unsigned int* counter[MISS_DEPTH];
+    misses_counters(mt, hash, counter);
+    unsigned int least = ~0U;
+    for (int i = 0; i < MISS_DEPTH; i++) {
+        if (*counter[i] < least) {
+            least = *counter[i];
+        }
+    }
+    if (least == 0) {
+        return;
+    }
+    for (int i = 0; i < MISS_DEPTH; i++) {
+        *counter[i] -= least;
+    }
+
+    // Move the last candidate into its place in the heap
+    int i = misses_find(mt, (unsigned long)hash, intent, entity);
+    if (i < 0) {
+        return;
+    }
+    mt->top[i] = mt->top[--mt->top_count];
+    if (i < mt->top_count) {
+        misses_sift_up(mt, i);
+        misses_sift_down(mt, i);
+    }
+}
+
+
+/*
+ * Compare two questions by count, most counted first.
+ */
+static int misses_compare(const void *a, const void *b) {
+    unsigned long count_a = ((const MissCount*)a)->count, count_b = ((const MissCount*)b)->count;
+    return count_a < count_b ? 1 : count_a > count_b ? -1 : 0;
+}
+
+
+/*
+ * List the unanswered questions counted most often.
+ *
+ * Input:
+ *   mt  - the tracker
+ *   top - receives the questions, most counted first
+ *   k   - the most questions to list
+ *
+ * Returns: the number of questions listed
+ */
+int misses_top(const MissTracker *mt, MissCount *top, int k) {
+    if (mt == NULL || top == NULL || k <= 0) {
+        return 0;
+    }
+
+    MissCount all[MISS_TOP];
+    for (int i = 0; i < mt->top_count; i++) {
+        all[i] = mt->top[i].miss;
+    }
+    if (mt->top_count > 0) {
+        qsort(all, mt->top_count, sizeof(MissCount), misses_compare);
+    }
+
+    int count = mt->top_count < k ? mt->top_count : k;
+    memcpy(top, all, count * sizeof(MissCount));
+    return count;
+}
@@ -0,0 +1,583 @@
+/* -----------------------------------------------------------------------------
+   Chatbot full-text search.
+   Team ID:      
+   Team Name:    
+   Filename:     search.c
+   Version:      2024-1.0
+   Description:  C source for the full-text search index in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by 
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file implements an inverted index over the words of every entity and
+ * response in the knowledge base, ranked with BM25. It lets the chatbot answer
+ * questions whose words only appear inside a response, such as "who teaches
+ * ICT1501C".
+ *
+ * search_create() makes an empty index.
+ * search_add() indexes an entry, replacing any earlier version of it.
+ * search_query() finds the best-matching entries for a query.
+ * search_clear() empties the index.
+ * search_destroy() frees the index.
+ *
+ * Every entry is a document with a number that only ever grows. Each word
+ * keeps a posting list of (document, count) pairs, stored as variable-length
+ * integers with the document numbers delta-encoded. Replacing an entry marks
+ * its old document dead rather than editing the posting lists; the owner
+ * rebuilds the index once search_stale() reports too many dead documents.
+ *
+ * A match has to be good enough to be worth answering with. One shared word
+ * is not enough ("what is a computer" should not be answered with an entry
+ * that mentions computer engineering), and neither is a match that misses
+ * most of the weight of the query's words.
+ */
+
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chat1503C.h"
+
+/* BM25 parameters */
+#define BM25_K1         1.2
+#define BM25_B          0.75
+
+/* the maximum number of characters in an indexed word (including the terminating null) */
+#define MAX_TERM        32
+
+/* the maximum number of distinct words taken from one query */
+#define MAX_QUERY_TERMS 32
+
+/* a hit must contain at least this many distinct words of the query... */
+#define SEARCH_MIN_TERMS 2
+
+/* ...and score at least this share of what an average-length entry holding
+   each of the query's words once would score */
+#define SEARCH_MIN_SHARE 0.5
+
+/* initial capacity of the hash tables (must be a power of two) */
+#define SEARCH_INITIAL  64
+
+
+typedef struct SearchDoc {
+    char intent[MAX_INTENT];
+    char entity[MAX_ENTITY];
+    int length;                     // number of indexed words
+    int live;                       // 0 once a newer version has been added
+} SearchDoc;
+
+typedef struct SearchTerm {
+    char text[MAX_TERM];
+    unsigned char* postings;        // varint (doc delta, count) pairs
+    int size;
+    int capacity;
+    int last_doc;                   // the last document in the posting list
+    int df;                         // the number of postings
+} SearchTerm;
+
+struct SearchIndex {
+    SearchDoc* docs;
+    int doc_count;
+    int doc_capacity;
+    int live_docs;
+    long live_length;               // total length of the live documents
+
+    int* doc_slots;                 // (intent, entity) -> live document, -1 if empty
+    int doc_slot_capacity;
+
+    SearchTerm* terms;              // open-addressed; text[0] == '\0' if empty
+    int term_count;
+    int term_capacity;
+
+    double* scores;                 // per-document accumulator for search_query()
+    int* touched;                   // the documents with a non-zero score
+    unsigned char* matched;         // per-document count of query words found
+};
+
+/* words too common to say anything about an entry */
+static const char *search_stopwords[] = {
+    "a", "an", "and", "are", "as", "at", "by", "for", "in", "is", "it", "of",
+    "on", "or", "the", "to", "what", "where", "who", "with", NULL
+};
+
+
+/*
+ * Hash a string case-insensitively (FNV-1a).
+ */
+static unsigned long search_hash(const char *text, unsigned long hash) {
+    for (int i = 0; text[i] != '\0'; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)text[i]);
+        hash *= 16777619UL;
+    }
+    return hash & 0xFFFFFFFFUL;
+}
+
+
+/*
+ * Copy the next word of some text into a buffer, lower-cased. Stop words are
+ * skipped.
+ *
+ * Input:
+ *   text - the text; advanced past the word
+ *   term - a buffer of MAX_TERM characters to receive the word
+ *
+ * Returns: 1 if a word was found, 0 at the end of the text
+ */
+static int search_next_term(const char **text, char *term) {
+    const char* p = *text;
+    for (;;) {
+        while (*p != '\0' && !isalnum((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            *text = p;
+            return 0;
+        }
+
+        int len = 0;
+        while (isalnum((unsigned char)*p)) {
+            if (len < MAX_TERM - 1) {
+                term[len++] = tolower((unsigned char)*p);
+            }
+            p++;
+        }
+        term[len] = '\0';
+
+        int stop = 0;
+        for (int i = 0; search_stopwords[i] != NULL; i++) {
+            if (strcmp(term, search_stopwords[i]) == 0) {
+                stop = 1;
+                break;
+            }
+        }
+        if (!stop) {
+            *text = p;
+            return 1;
+        }
+    }
+}
+
+
+/*
+ * Find the slot of a word in the term table.
+ *
+ * Returns: the slot holding the word, or the empty slot where it belongs
+ */
+static int search_term_slot(const SearchIndex *ix, const char *term) {
+    int mask = ix->term_capacity - 1;
+    int slot = (int)(search_hash(term, 2166136261UL) & mask);
+    while (ix->terms[slot].text[0] != '\0' && strcmp(ix->terms[slot].text, term) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/*
+ * Find the slot of an entry in the document table.
+ *
+ * Returns: the slot holding the entry's live document, or the empty slot where it belongs
+ */
+static int search_doc_slot(const SearchIndex *ix, const char *intent, const char *entity) {
+    int mask = ix->doc_slot_capacity - 1;
+    int slot = (int)(search_hash(entity, search_hash(intent, 2166136261UL)) & mask);
+    while (ix->doc_slots[slot] >= 0) {
+        const SearchDoc* doc = &ix->docs[ix->doc_slots[slot]];
+        if (strcasecmp(doc->intent, intent) == 0 && strcasecmp(doc->entity, entity) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/*
+ * Double the size of the term table.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int search_grow_terms(SearchIndex *ix) {
+    SearchTerm* old = ix->terms;
+    int old_capacity = ix->term_capacity;
+
+    ix->terms = (SearchTerm*)calloc(old_capacity * 2, sizeof(SearchTerm));
+    if (ix->terms == NULL) {
+        ix->terms = old;
+        return KB_NOMEM;
+    }
+    ix->term_capacity = old_capacity * 2;
+
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i].text[0] != '\0') {
+            ix->terms[search_term_slot(ix, old[i].text)] = old[i];
+        }
+    }
+    free(old);
+    return KB_OK;
+}
+
+
+/*
+ * Double the size of the document slot table.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int search_grow_doc_slots(SearchIndex *ix) {
+    int* old = ix->doc_slots;
+    int old_capacity = ix->doc_slot_capacity;
+
+    ix->doc_slots = (int*)malloc(old_capacity * 2 * sizeof(int));
+    if (ix->doc_slots == NULL) {
+        ix->doc_slots = old;
+        return KB_NOMEM;
+    }
+    ix->doc_slot_capacity = old_capacity * 2;
+    memset(ix->doc_slots, 0xFF, ix->doc_slot_capacity * sizeof(int));
+
+    for (int i = 0; i < old_capacity; i++) {
+        if (old[i] >= 0) {
+            const SearchDoc* doc = &ix->docs[old[i]];
+            ix->doc_slots[search_doc_slot(ix, doc->intent, doc->entity)] = old[i];
+        }
+    }
+    free(old);
+    return KB_OK;
+}
+
+
+/*
+ * Append a variable-length integer to a posting list.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int search_put_varint(SearchTerm *term, unsigned int value) {
+    if (term->size + 5 > term->capacity) {
+        int capacity = term->capacity == 0 ? 16 : term->capacity * 2;
+        unsigned char* postings = (unsigned char*)realloc(term->postings, capacity);
+        if (postings == NULL) {
+            return KB_NOMEM;
+        }
+        term->postings = postings;
+        term->capacity = capacity;
+    }
+
+    while (value >= 0x80) {
+        term->postings[term->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    term->postings[term->size++] = (unsigned char)value;
+    return KB_OK;
+}
+
+
+/*
+ * Read a variable-length integer from a posting list.
+ */
+static unsigned int search_get_varint(const unsigned char **p) {
+    unsigned int value = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        value |= (unsigned int)(*(*p)++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= (unsigned int)*(*p)++ << shift;
+    return value;
+}
+
+
+/*
+ * Create an empty index.
+ *
+ * Returns: the index, or NULL if there was a memory allocation failure
+ */
+SearchIndex *search_create() {
+    SearchIndex* ix = (SearchIndex*)calloc(1, sizeof(SearchIndex));
+    if (ix == NULL) {
+        return NULL;
+    }
+
+    ix->terms = (SearchTerm*)calloc(SEARCH_INITIAL, sizeof(SearchTerm));
+    ix->doc_slots = (int*)malloc(SEARCH_INITIAL * sizeof(int));
+    if (ix->terms == NULL || ix->doc_slots == NULL) {
+        free(ix->terms);
+        free(ix->doc_slots);
+        free(ix);
+        return NULL;
+    }
+    ix->term_capacity = SEARCH_INITIAL;
+    ix->doc_slot_capacity = SEARCH_INITIAL;
+    memset(ix->doc_slots, 0xFF, SEARCH_INITIAL * sizeof(int));
+    return ix;
+}
+
+
+/*
+ * Remove every entry from an index.
+ */
+void search_clear(SearchIndex *ix) {
+    if (ix == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < ix->term_capacity; i++) {
+        free(ix->terms[i].postings);
+    }
+    memset(ix->terms, 0, ix->term_capacity * sizeof(SearchTerm));
+    memset(ix->doc_slots, 0xFF, ix->doc_slot_capacity * sizeof(int));
+    ix->term_count = 0;
+    ix->doc_count = 0;
+    ix->live_docs = 0;
+    ix->live_length = 0;
+}
+
+
+/*
+ * Free an index.
+ */
+void search_destroy(SearchIndex *ix) {
+    if (ix == NULL) {
+        return;
+    }
+
+    search_clear(ix);
+    free(ix->terms);
+    free(ix->doc_slots);
+    free(ix->docs);
+    free(ix->scores);
+    free(ix->touched);
+    free(ix->matched);
+    free(ix);
+}
+
+
+/*
+ * Index an entry, replacing the document of any earlier version of it.
+ *
+ * Input:
+ *   ix       - the index
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - the response
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_NOMEM, if there was a memory allocation failure (the entry is not searchable)
+ */
+int search_add(SearchIndex *ix, const char *intent, const char *entity, const char *response) {
+    if ((ix->doc_count + 1) * 2 > ix->doc_slot_capacity && search_grow_doc_slots(ix) != KB_OK) {
+        return KB_NOMEM;
+    }
+
+    if (ix->doc_count == ix->doc_capacity) {
+        int capacity = ix->doc_capacity == 0 ? SEARCH_INITIAL : ix->doc_capacity * 2;
+        SearchDoc* docs = (SearchDoc*)realloc(ix->docs, capacity * sizeof(SearchDoc));
+        double* scores = (double*)realloc(ix->scores, capacity * sizeof(double));
+        int* touched = (int*)realloc(ix->touched, capacity * sizeof(int));
+        unsigned char* matched = (unsigned char*)realloc(ix->matched, capacity);
+        if (docs != NULL) ix->docs = docs;
+        if (scores != NULL) ix->scores = scores;
+        if (touched != NULL) ix->touched = touched;
+        if (matched != NULL) ix->matched = matched;
+        if (docs == NULL || scores == NULL || touched == NULL || matched == NULL) {
+            return KB_NOMEM;
+        }
+        for (int i = ix->doc_capacity; i < capacity; i++) {
+            ix->scores[i] = 0.0;
+            ix->matched[i] = 0;
+        }
+        ix->doc_capacity = capacity;
+    }
+
+    // Retire the previous version of the entry
+    int slot = search_doc_slot(ix, intent, entity);
+    if (ix->doc_slots[slot] >= 0) {
+        SearchDoc* old = &ix->docs[ix->doc_slots[slot]];
+        old->live = 0;
+        ix->live_docs--;
+        ix->live_length -= old->length;
+    }
+
+    int id = ix->doc_count++;
+    SearchDoc* doc = &ix->docs[id];
+    strncpy(doc->intent, intent, MAX_INTENT - 1);
+    doc->intent[MAX_INTENT - 1] = '\0';
+    strncpy(doc->entity, entity, MAX_ENTITY - 1);
+    doc->entity[MAX_ENTITY - 1] = '\0';
+    doc->length = 0;
+    doc->live = 1;
+    ix->doc_slots[slot] = id;
+
+    // Post every word of the entity and the response
+    const char* texts[] = {entity, response};
+    char term[MAX_TERM];
+    for (int t = 0; t < 2; t++) {
+        const char* p = texts[t];
+        while (search_next_term(&p, term)) {
+            doc->length++;
+
+            if ((ix->term_count + 1) * 2 > ix->term_capacity && search_grow_terms(ix) != KB_OK) {
+                continue;
+            }
+
+            SearchTerm* entry = &ix->terms[search_term_slot(ix, term)];
+            if (entry->text[0] == '\0') {
+                strcpy(entry->text, term);
+                entry->last_doc = -1;
+                ix->term_count++;
+            }
+
+            // Repeats of a word within the document bump the count of its last
+            // posting, which is rewritten in place
+            if (entry->last_doc == id) {
+                int count_start = entry->size - 1;
+                while (count_start > 0 && (entry->postings[count_start - 1] & 0x80)) {
+                    count_start--;
+                }
+                const unsigned char* last = entry->postings + count_start;
+                unsigned int count = search_get_varint(&last);
+                entry->size = count_start;
+                search_put_varint(entry, count + 1);
+            } else {
+                int delta = id - (entry->last_doc < 0 ? 0 : entry->last_doc);
+                if (search_put_varint(entry, (unsigned int)delta) != KB_OK ||
+                    search_put_varint(entry, 1) != KB_OK) {
+                    continue;
+                }
+                entry->last_doc = id;
+                entry->df++;
+            }
+        }
+    }
+
+    ix->live_docs++;
+    ix->live_length += doc->length;
+    return KB_OK;
+}
+
+
+/*
+ * Determine whether an index is mostly made of replaced documents and should
+ * be rebuilt from scratch.
+ *
+ * Returns:
+ *   1, if dead documents outnumber live ones
+ *   0, otherwise
+ */
+int search_stale(const SearchIndex *ix) {
+    return ix != NULL && ix->doc_count > SEARCH_INITIAL && ix->doc_count - ix->live_docs > ix->live_docs;
+}
+
+
+/*
+ * Find the entries that best match a query, ranked by BM25. Entries with
+ * fewer than SEARCH_MIN_TERMS of the query's words, or scoring less than
+ * SEARCH_MIN_SHARE of the query's ideal score, are not hits.
+ *
+ * Input:
+ *   ix     - the index
+ *   intent - only match entries for this question word, or NULL for any
+ *   query  - the words to look for
+ *   hits   - receives the entities of the best matches, best first
+ *   k      - the maximum number of hits
+ *
+ * Returns: the number of hits
+ */
+int search_query(SearchIndex *ix, const char *intent, const char *query, SearchHit *hits, int k) {
+    if (ix == NULL || query == NULL || hits == NULL || k <= 0 || ix->live_docs == 0) {
+        return 0;
+    }
+
+    // Collect the distinct words of the query
+    char terms[MAX_QUERY_TERMS][MAX_TERM];
+    int term_count = 0;
+    char term[MAX_TERM];
+    const char* p = query;
+    while (term_count < MAX_QUERY_TERMS && search_next_term(&p, term)) {
+        int seen = 0;
+        for (int i = 0; i < term_count; i++) {
+            if (strcmp(terms[i], term) == 0) {
+                seen = 1;
+                break;
+            }
+        }
+        if (!seen) {
+            strcpy(terms[term_count++], term);
+        }
+    }
+
+    // Accumulate the score of every document on the words' posting lists.
+    // An average-length document with each word once would score the sum of
+    // their idfs, counting words no document has at the highest idf.
+    double avgdl = (double)ix->live_length / ix->live_docs;
+    double ideal = 0.0;
+    int touched = 0;
+    for (int i = 0; i < term_count; i++) {
+        const SearchTerm* entry = &ix->terms[search_term_slot(ix, terms[i])];
+        if (entry->text[0] == '\0') {
+            ideal += log(1.0 + (ix->live_docs + 0.5) / 0.5);
+            continue;
+        }
+
+        double idf = log(1.0 + (ix->live_docs - entry->df + 0.5) / (entry->df + 0.5));
+        if (idf <= 0.0) {
+            idf = 1e-6;
+        }
+        ideal += idf;
+
+        const unsigned char* q = entry->postings;
+        const unsigned char* end = entry->postings + entry->size;
+        int id = 0;
+        while (q < end) {
+            id += (int)search_get_varint(&q);
+            unsigned int tf = search_get_varint(&q);
+
+            const SearchDoc* doc = &ix->docs[id];
+            if (!doc->live || (intent != NULL && strcasecmp(doc->intent, intent) != 0)) {
+                continue;
+            }
+
+            double norm = BM25_K1 * (1.0 - BM25_B + BM25_B * doc->length / avgdl);
+            if (ix->scores[id] == 0.0) {
+                ix->touched[touched++] = id;
+            }
+            ix->scores[id] += idf * (tf * (BM25_K1 + 1.0)) / (tf + norm);
+            ix->matched[id]++;
+        }
+    }
+
+    // Keep the k best good enough, clearing the accumulators as we go
+    int hit_count = 0;
+    for (int i = 0; i < touched; i++) {
+        int id = ix->touched[i];
+        double score = ix->scores[id];
+        int matched = ix->matched[id];
+        ix->scores[id] = 0.0;
+        ix->matched[id] = 0;
+        if (matched < SEARCH_MIN_TERMS || score < SEARCH_MIN_SHARE * ideal) {
+            continue;
+        }
+
+        int pos = hit_count < k ? hit_count++ : k;
+        while (pos > 0 && hits[pos - 1].score < score) {
+            if (pos < k) {
+                hits[pos] = hits[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < k) {
+            strcpy(hits[pos].entity, ix->docs[id].entity);
+            hits[pos].score = score;
+        }
+    }
+
+    return hit_count;
+}
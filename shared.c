@@ -0,0 +1,605 @@
+/* -----------------------------------------------------------------------------
+   Chatbot shared-memory knowledge base.
+   Team ID:
+   Team Name:
+   Filename:     shared.c
+   Version:      2024-1.0
+   Description:  C source for the shared-memory knowledge base in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file places a knowledge base in POSIX shared memory, so that many
+ * chatbot processes on one host can answer from a single copy of it instead
+ * of each parsing and holding its own.
+ *
+ * shared_publish() makes this process the publisher of a named knowledge base.
+ * shared_begin(), shared_put() and shared_commit() build a new image of it.
+ * shared_put() also adds or replaces one entry in the current image.
+ * shared_attach() maps a published knowledge base read-only.
+ * shared_get() reads the response for one intent and entity.
+ * shared_close() unmaps it.
+ *
+ * A knowledge base named "/name" is two kinds of shared memory object. The
+ * image "/name.N" holds an open-addressed table of slots followed by a pool
+ * of strings; slots refer to strings by their offset in the image. The
+ * header "/name" holds the generation N of the current image, and is the
+ * pointer that is swapped when a new image is published: readers notice the
+ * new generation on their next lookup and map the new image instead. Old
+ * images are unlinked by the publisher, but stay mapped until every reader
+ * has moved on.
+ *
+ * Strings are only ever appended to an image, so a put that fits is made
+ * in place: the publisher writes the new strings past the end of the pool,
+ * then points the slot at them between two increments of the image's
+ * sequence number (a seqlock). A reader notes the sequence number before a
+ * lookup and tries again if it was odd (a write in progress) or has changed
+ * by the end; if it keeps changing, the lookup fails with KB_BUSY rather
+ * than claiming the entry is not there. A put that does not fit makes the caller build a new image,
+ * twice as roomy, and publish that instead.
+ *
+ * Shared memory is not supported on Windows; shared_publish() and
+ * shared_attach() fail there.
+ */
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "chat1503C.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* identifies (and versions) the header and image formats */
+#define SHARED_MAGIC      0x4B425348U
+
+/* the maximum number of characters in the name of a knowledge base, and
+   of one of its shared memory objects (the name and a generation number) */
+#define SHARED_MAX_NAME   256
+#define SHARED_MAX_OBJECT (SHARED_MAX_NAME + 12)
+
+/* the least number of slots and bytes of strings in an image */
+#define SHARED_MIN_SLOTS  64
+#define SHARED_MIN_POOL   (64 * 1024)
+
+/* the number of times a reader tries a lookup that keeps being written over,
+   or an image that keeps being replaced, before giving up with KB_BUSY */
+#define SHARED_RETRIES    1000
+
+
+typedef struct SharedHeader {
+    uint32_t magic;
+    uint32_t generation;            // the current image is "name.generation"
+} SharedHeader;
+
+typedef struct SharedSlot {
+    uint32_t hash;                  // shared_hash() of the intent and entity
+    uint32_t key;                   // offset of "intent\0entity\0", 0 if empty
+    uint32_t response;              // offset of "response\0"
+} SharedSlot;
+
+typedef struct SharedImage {
+    uint32_t magic;
+    uint32_t seq;                   // odd while a slot is being written
+    uint32_t slot_capacity;         // a power of two
+    uint32_t count;
+    uint32_t size;                  // of the whole image, in bytes
+    uint32_t used;                  // offset of the end of the strings
+    SharedSlot slots[];             // followed by the strings
+} SharedImage;
+
+struct SharedKnowledge {
+    char name[SHARED_MAX_NAME];
+    int publisher;
+    SharedHeader* header;
+    SharedImage* image;             // the image mapped, or NULL
+    uint32_t generation;            // of the image mapped
+    SharedImage* next;              // the image being built by the publisher
+    uint32_t next_generation;
+};
+
+
+/*
+ * Hash an intent and entity case-insensitively (FNV-1a).
+ */
+static uint32_t shared_hash(const char *intent, const char *entity) {
+    uint32_t hash = 2166136261U;
+    for (const char* p = intent; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)toupper((unsigned char)*p)) * 16777619U;
+    }
+    hash = (hash ^ '\t') * 16777619U;
+    for (const char* p = entity; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)toupper((unsigned char)*p)) * 16777619U;
+    }
+    return hash;
+}
+
+
+/*
+ * Compare a string in an image with another, case-insensitively, without
+ * reading past the end of the image (a reader may be looking at an offset
+ * torn by a concurrent write).
+ *
+ * Returns: the offset just past the string in the image if they are equal, 0 otherwise
+ */
+static uint32_t shared_match(const SharedImage *image, uint32_t offset, const char *s) {
+    const char* base = (const char*)image;
+    uint32_t size = image->size;
+    while (offset < size) {
+        if (toupper((unsigned char)base[offset]) != toupper((unsigned char)*s)) {
+            return 0;
+        }
+        if (*s == '\0') {
+            return offset + 1;
+        }
+        offset++;
+        s++;
+    }
+    return 0;
+}
+
+
+#ifndef _WIN32
+/*
+ * Make the name of one of a knowledge base's shared memory objects.
+ */
+static void shared_object_name(char *out, const char *name, uint32_t generation) {
+    if (generation == 0) {
+        snprintf(out, SHARED_MAX_OBJECT, "%s", name);
+    } else {
+        snprintf(out, SHARED_MAX_OBJECT, "%s.%u", name, (unsigned)generation);
+    }
+}
+
+
+/*
+ * Map a shared memory object.
+ *
+ * Input:
+ *   object - its name
+ *   size   - its size if it is to be created (or resized) and mapped for
+ *            writing, or 0 to map an existing one read-only
+ *   mapped - receives the size mapped
+ *
+ * Returns: the mapping, or NULL if it could not be made
+ */
+static void* shared_map(const char *object, size_t size, size_t *mapped) {
+    int create = size != 0;
+    int fd = create ? shm_open(object, O_RDWR | O_CREAT, 0644) : shm_open(object, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (create ? ftruncate(fd, (off_t)size) != 0 : fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    if (!create) {
+        size = (size_t)st.st_size;
+    }
+
+    void* p = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    *mapped = size;
+    return p;
+}
+
+
+/*
+ * Map the current image of a knowledge base, if it is not already mapped.
+ *
+ * Returns:
+ *   KB_OK, if the current image is mapped
+ *   KB_NOTFOUND, if nothing has been published yet
+ *   KB_BUSY, if every image tried was replaced before it could be opened
+ *   KB_INVALID, if the image is not a knowledge base
+ */
+static int shared_refresh(SharedKnowledge *sh) {
+    for (int tries = 0; tries < SHARED_RETRIES; tries++) {
+        uint32_t generation = __atomic_load_n(&sh->header->generation, __ATOMIC_ACQUIRE);
+        if (generation == sh->generation && sh->image != NULL) {
+            return KB_OK;
+        }
+        if (generation == 0) {
+            return KB_NOTFOUND;
+        }
+
+        // The publisher may unlink the image before it can be opened, in
+        // which case there is a newer one
+        char object[SHARED_MAX_OBJECT];
+        size_t size;
+        shared_object_name(object, sh->name, generation);
+        SharedImage* image = (SharedImage*)shared_map(object, 0, &size);
+        if (image == NULL) {
+            continue;
+        }
+        if (size < sizeof(SharedImage) || image->magic != SHARED_MAGIC || image->size != size) {
+            munmap(image, size);
+            return KB_INVALID;
+        }
+
+        if (sh->image != NULL) {
+            munmap(sh->image, sh->image->size);
+        }
+        sh->image = image;
+        sh->generation = generation;
+        return KB_OK;
+    }
+    return KB_BUSY;
+}
+
+
+/*
+ * Open a knowledge base's header, creating it if this is the publisher.
+ *
+ * Returns: the knowledge base, or NULL if the header could not be mapped
+ */
+static SharedKnowledge* shared_open(const char *name, int publisher) {
+    if (name == NULL || name[0] == '\0' || strlen(name) + 2 > SHARED_MAX_NAME) {
+        return NULL;
+    }
+
+    SharedKnowledge* sh = (SharedKnowledge*)calloc(1, sizeof(SharedKnowledge));
+    if (sh == NULL) {
+        return NULL;
+    }
+    snprintf(sh->name, sizeof(sh->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    sh->publisher = publisher;
+
+    size_t size = 0;
+    sh->header = (SharedHeader*)shared_map(sh->name, publisher ? sizeof(SharedHeader) : 0, &size);
+    if (sh->header == NULL || (!publisher && (size < sizeof(SharedHeader) || sh->header->magic != SHARED_MAGIC))) {
+        if (sh->header != NULL) {
+            munmap(sh->header, size);
+        }
+        free(sh);
+        return NULL;
+    }
+
+    if (publisher) {
+        // Carry on from the generation of any earlier publisher, whose image
+        // is unlinked once this one's first is published
+        sh->header->magic = SHARED_MAGIC;
+        sh->generation = __atomic_load_n(&sh->header->generation, __ATOMIC_ACQUIRE);
+    }
+    return sh;
+}
+#endif
+
+
+/*
+ * Become the publisher of a knowledge base in shared memory. Nothing is
+ * published until the first image is committed with shared_commit().
+ *
+ * Input:
+ *   name - the name of the knowledge base, shared with the readers
+ *
+ * Returns: the knowledge base, or NULL if it could not be created
+ */
+SharedKnowledge *shared_publish(const char *name) {
+#ifndef _WIN32
+    return shared_open(name, 1);
+#else
+    return NULL;
+#endif
+}
+
+
+/*
+ * Map a knowledge base published by another process, read-only.
+ *
+ * Input:
+ *   name - the name the publisher gave it
+ *
+ * Returns: the knowledge base, or NULL if nothing is published under that name
+ */
+SharedKnowledge *shared_attach(const char *name) {
+#ifndef _WIN32
+    SharedKnowledge* sh = shared_open(name, 0);
+    if (sh != NULL && shared_refresh(sh) != KB_OK) {
+        shared_close(sh);
+        return NULL;
+    }
+    return sh;
+#else
+    return NULL;
+#endif
+}
+
+
+/*
+ * Unmap a knowledge base. What a publisher published stays available to
+ * readers until the next publisher under the same name replaces it.
+ */
+void shared_close(SharedKnowledge *sh) {
+    if (sh == NULL) {
+        return;
+    }
+
+#ifndef _WIN32
+    if (sh->next != NULL) {
+        char object[SHARED_MAX_OBJECT];
+        shared_object_name(object, sh->name, sh->next_generation);
+        munmap(sh->next, sh->next->size);
+        shm_unlink(object);
+    }
+    if (sh->image != NULL) {
+        munmap(sh->image, sh->image->size);
+    }
+    if (sh->header != NULL) {
+        munmap(sh->header, sizeof(SharedHeader));
+    }
+#endif
+    free(sh);
+}
+
+
+/*
+ * Start building a new image, to be filled with shared_put() and published
+ * with shared_commit(). Until then, readers go on using the current image.
+ *
+ * Input:
+ *   sh    - the knowledge base, which must be the publisher's
+ *   count - the number of entries the image will hold
+ *   bytes - the number of characters of their intents, entities and
+ *           responses, including a terminating null each
+ *
+ * Returns: KB_OK, KB_INVALID if this is not the publisher, or KB_NOMEM
+ */
+int shared_begin(SharedKnowledge *sh, int count, size_t bytes) {
+#ifndef _WIN32
+    if (sh == NULL || !sh->publisher || count < 0) {
+        return KB_INVALID;
+    }
+
+    if (sh->next != NULL) {
+        char object[SHARED_MAX_OBJECT];
+        shared_object_name(object, sh->name, sh->next_generation);
+        munmap(sh->next, sh->next->size);
+        shm_unlink(object);
+        sh->next = NULL;
+    }
+
+    // Leave room for as many entries again before the next image is needed
+    uint64_t slots = SHARED_MIN_SLOTS;
+    while (slots < 4 * (uint64_t)count) {
+        slots *= 2;
+    }
+    uint64_t pool = 2 * (uint64_t)bytes + SHARED_MIN_POOL;
+    uint64_t size = sizeof(SharedImage) + slots * sizeof(SharedSlot) + pool;
+    if (size > UINT32_MAX) {
+        return KB_NOMEM;
+    }
+
+    char object[SHARED_MAX_OBJECT];
+    size_t mapped;
+    uint32_t generation = sh->generation + 1 != 0 ? sh->generation + 1 : 1;
+    shared_object_name(object, sh->name, generation);
+    SharedImage* image = (SharedImage*)shared_map(object, (size_t)size, &mapped);
+    if (image == NULL) {
+        shm_unlink(object);
+        return KB_NOMEM;
+    }
+
+    memset(image, 0, sizeof(SharedImage) + slots * sizeof(SharedSlot));
+    image->magic = SHARED_MAGIC;
+    image->slot_capacity = (uint32_t)slots;
+    image->size = (uint32_t)size;
+    image->used = (uint32_t)(sizeof(SharedImage) + slots * sizeof(SharedSlot));
+    sh->next = image;
+    sh->next_generation = generation;
+    return KB_OK;
+#else
+    return KB_INVALID;
+#endif
+}
+
+
+/*
+ * Publish the image built since shared_begin() in place of the current one.
+ *
+ * Returns: KB_OK, or KB_INVALID if no image is being built
+ */
+int shared_commit(SharedKnowledge *sh) {
+#ifndef _WIN32
+    if (sh == NULL || sh->next == NULL) {
+        return KB_INVALID;
+    }
+
+    __atomic_store_n(&sh->header->generation, sh->next_generation, __ATOMIC_RELEASE);
+
+    if (sh->generation != 0) {
+        char object[SHARED_MAX_OBJECT];
+        shared_object_name(object, sh->name, sh->generation);
+        shm_unlink(object);
+    }
+    if (sh->image != NULL) {
+        munmap(sh->image, sh->image->size);
+    }
+    sh->image = sh->next;
+    sh->generation = sh->next_generation;
+    sh->next = NULL;
+    return KB_OK;
+#else
+    return KB_INVALID;
+#endif
+}
+
+
+/*
+ * Add or replace an entry in the image being built, or if none is, in the
+ * current image (where readers see it at once).
+ *
+ * Input:
+ *   sh       - the knowledge base, which must be the publisher's
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - the response
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the inputs are invalid or this is not the publisher
+ *   KB_NOMEM, if the image is full (a new one must be built)
+ */
+int shared_put(SharedKnowledge *sh, const char *intent, const char *entity, const char *response) {
+    if (sh == NULL || !sh->publisher || intent == NULL || entity == NULL || response == NULL) {
+        return KB_INVALID;
+    }
+
+    SharedImage* image = sh->next != NULL ? sh->next : sh->image;
+    if (image == NULL) {
+        return KB_NOMEM;
+    }
+
+    uint32_t hash = shared_hash(intent, entity);
+    uint32_t mask = image->slot_capacity - 1;
+    uint32_t i = hash & mask;
+    while (image->slots[i].key != 0) {
+        if (image->slots[i].hash == hash) {
+            uint32_t past = shared_match(image, image->slots[i].key, intent);
+            if (past != 0 && shared_match(image, past, entity) != 0) {
+                break;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+
+    // Keep the table at most half full
+    SharedSlot* slot = &image->slots[i];
+    if (slot->key == 0 && (image->count + 1) * 2 > image->slot_capacity) {
+        return KB_NOMEM;
+    }
+
+    size_t intent_len = strlen(intent) + 1, entity_len = strlen(entity) + 1, response_len = strlen(response) + 1;
+    size_t needed = response_len + (slot->key == 0 ? intent_len + entity_len : 0);
+    if (needed > image->size - image->used) {
+        return KB_NOMEM;
+    }
+
+    // Write the strings where no reader looks yet
+    char* base = (char*)image;
+    uint32_t key = slot->key;
+    if (key == 0) {
+        key = image->used;
+        memcpy(base + image->used, intent, intent_len);
+        memcpy(base + image->used + intent_len, entity, entity_len);
+        image->used += (uint32_t)(intent_len + entity_len);
+    }
+    uint32_t text = image->used;
+    memcpy(base + image->used, response, response_len);
+    image->used += (uint32_t)response_len;
+
+    // Then point the slot at them
+    __atomic_store_n(&image->seq, image->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->response, text, __ATOMIC_RELAXED);
+    if (slot->key == 0) {
+        __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->key, key, __ATOMIC_RELAXED);
+        image->count++;
+    }
+    __atomic_store_n(&image->seq, image->seq + 1, __ATOMIC_RELEASE);
+    return KB_OK;
+}
+
+
+/*
+ * Get the response to a question from the current image.
+ *
+ * Input:
+ *   sh       - the knowledge base
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - a buffer to receive the response
+ *   n        - the maximum number of characters to write to the response buffer
+ *
+ * Returns:
+ *   KB_OK, if a response was found (it is copied to the response buffer)
+ *   KB_NOTFOUND, if no response could be found
+ *   KB_BUSY, if the image kept being written or replaced during the lookup;
+ *            whether there is a response is not known, so try again
+ *   KB_INVALID, if the inputs are invalid or the image is not a knowledge base
+ */
+int shared_get(SharedKnowledge *sh, const char *intent, const char *entity, char *response, int n) {
+    if (sh == NULL || intent == NULL || entity == NULL || response == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+#ifndef _WIN32
+    if (!sh->publisher) {
+        int result = shared_refresh(sh);
+        if (result != KB_OK) {
+            return result;
+        }
+    }
+#endif
+    const SharedImage* image = sh->image;
+    if (image == NULL) {
+        return KB_NOTFOUND;
+    }
+
+    uint32_t hash = shared_hash(intent, entity);
+    uint32_t mask = image->slot_capacity - 1;
+    for (int tries = 0; tries < SHARED_RETRIES; tries++) {
+        uint32_t seq = __atomic_load_n(&image->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            // Let the publisher finish the write
+#ifndef _WIN32
+            sched_yield();
+#endif
+            continue;
+        }
+
+        int result = KB_NOTFOUND;
+        for (uint32_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+            uint32_t key = __atomic_load_n(&image->slots[i].key, __ATOMIC_RELAXED);
+            if (key == 0) {
+                break;
+            }
+            if (__atomic_load_n(&image->slots[i].hash, __ATOMIC_RELAXED) != hash) {
+                continue;
+            }
+            uint32_t past = shared_match(image, key, intent);
+            if (past == 0 || shared_match(image, past, entity) == 0) {
+                continue;
+            }
+
+            // Copy no further than the end of the image
+            uint32_t text = __atomic_load_n(&image->slots[i].response, __ATOMIC_RELAXED);
+            const char* base = (const char*)image;
+            int len = 0;
+            while (len < n - 1 && text + len < image->size && base[text + len] != '\0') {
+                response[len] = base[text + len];
+                len++;
+            }
+            response[len] = '\0';
+            result = KB_OK;
+            break;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&image->seq, __ATOMIC_RELAXED) == seq) {
+            return result;
+        }
+    }
+    return KB_BUSY;
+}
@@ -0,0 +1,536 @@
+/* -----------------------------------------------------------------------------
+   Chatbot knowledge file index.
+   Team ID:      
+   Team Name:    
+   Filename:     sidecar.c
+   Version:      2024-1.0
+   Description:  C source for the knowledge file offset index in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by 
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file implements a sidecar index for knowledge files, so that entries
+ * can be read from a file one at a time as they are asked for instead of
+ * parsing the whole file up front.
+ *
+ * sidecar_open() opens a knowledge file together with its index, building
+ * the index first if the file is new or has changed since.
+ * sidecar_find() reads the response for one intent and entity.
+ * sidecar_read_section() reads every entry of one [intent] section.
+ * sidecar_dup() opens a second handle onto the same version of the file.
+ * sidecar_close() closes the file and its index.
+ *
+ * The index is stored next to the file with SIDECAR_SUFFIX appended to its
+ * name. It records the size, modification time (to the nanosecond where the
+ * system keeps it) and file number of the file it describes, so that a file
+ * edited or replaced within the same second is still noticed. It also holds
+ * the offset of every section, and the offset of every entry sorted by a hash
+ * of its intent and entity. Looking an entry up is a binary search over the
+ * index on disk followed by reading one line of the file, so it costs the
+ * same however large the file is.
+ *
+ * An index is replaced by renaming a new one over it, never rewritten in
+ * place, so a handle that is still open keeps reading the version it opened.
+ */
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "chat1503C.h"
+
+/* appended to the name of a knowledge file to get the name of its index */
+#define SIDECAR_SUFFIX ".idx"
+
+/* identifies (and versions) the index format */
+#define SIDECAR_MAGIC  "KBIDX02"
+
+/* the maximum number of characters in a line of a knowledge file */
+#define MAX_LINE       (MAX_ENTITY + MAX_RESPONSE + 2)
+
+
+typedef struct SidecarHeader {
+    char magic[8];
+    int64_t file_size;              // of the knowledge file when it was indexed
+    int64_t file_mtime;
+    int64_t file_mtime_ns;          // the fraction of a second, or 0 if the system does not keep it
+    int64_t file_id;                // the file's inode number, or 0 if it has none
+    int32_t section_count;
+    int32_t entry_count;
+} SidecarHeader;
+
+typedef struct SidecarSection {
+    char name[MAX_INTENT];
+    int64_t offset;                 // of the first line after the [name] header
+} SidecarSection;
+
+typedef struct SidecarEntry {
+    uint32_t hash;                  // of the intent and entity
+    int32_t section;
+    int64_t offset;                 // of the entity=response line
+} SidecarEntry;
+
+struct Sidecar {
+    FILE* file;                     // the knowledge file
+    FILE* index;                    // its sidecar index
+    SidecarHeader header;
+    SidecarSection* sections;
+    char* section_loaded;           // set once sidecar_read_section() has read a section
+    long entries_offset;            // of the first SidecarEntry in the index
+};
+
+
+/*
+ * Hash an intent and entity case-insensitively (FNV-1a).
+ */
+static uint32_t sidecar_hash(const char *intent, const char *entity) {
+    uint32_t hash = 2166136261U;
+    for (int i = 0; intent[i] != '\0'; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)intent[i]);
+        hash *= 16777619U;
+    }
+    hash ^= '=';
+    hash *= 16777619U;
+    for (int i = 0; entity[i] != '\0'; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)entity[i]);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+/*
+ * Order index entries by hash, then by position in the file.
+ */
+static int sidecar_compare(const void *a, const void *b) {
+    const SidecarEntry* x = (const SidecarEntry*)a;
+    const SidecarEntry* y = (const SidecarEntry*)b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return x->offset < y->offset ? -1 : (x->offset > y->offset ? 1 : 0);
+}
+
+
+/*
+ * Read a line of a knowledge file without its line ending.
+ *
+ * Returns: 1 if a line was read, 0 at the end of the file
+ */
+static int sidecar_read_line(FILE *f, char *line, int n) {
+    if (fgets(line, n, f) == NULL) {
+        return 0;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    return 1;
+}
+
+
+/*
+ * Record what identifies a version of a knowledge file in an index header.
+ */
+static void sidecar_stamp(const struct stat *st, SidecarHeader *stamp) {
+    stamp->file_size = (int64_t)st->st_size;
+    stamp->file_mtime = (int64_t)st->st_mtime;
+#if defined(_WIN32)
+    stamp->file_mtime_ns = 0;
+    stamp->file_id = 0;
+#else
+#if defined(__APPLE__)
+    stamp->file_mtime_ns = (int64_t)st->st_mtimespec.tv_nsec;
+#else
+    stamp->file_mtime_ns = (int64_t)st->st_mtim.tv_nsec;
+#endif
+    stamp->file_id = (int64_t)st->st_ino;
+#endif
+}
+
+
+/*
+ * Scan a knowledge file and write its index.
+ *
+ * Input:
+ *   file  - the knowledge file
+ *   path  - the name of the index
+ *   stamp - the header, filled in by sidecar_stamp()
+ *
+ * Returns: KB_OK, KB_NOMEM, or KB_INVALID if the index could not be written
+ */
+static int sidecar_build(FILE *file, const char *path, SidecarHeader *stamp) {
+    SidecarSection* sections = NULL;
+    SidecarEntry* entries = NULL;
+    int section_capacity = 0, entry_capacity = 0;
+    int result = KB_NOMEM;
+    char line[MAX_LINE];
+
+    stamp->section_count = 0;
+    stamp->entry_count = 0;
+    rewind(file);
+
+    for (;;) {
+        long offset = ftell(file);
+        if (!sidecar_read_line(file, line, sizeof(line))) {
+            break;
+        }
+
+        if (line[0] == '[') {
+            char* end = strchr(line, ']');
+            if (end == NULL) {
+                continue;
+            }
+            *end = '\0';
+
+            if (stamp->section_count == section_capacity) {
+                section_capacity = section_capacity == 0 ? 8 : section_capacity * 2;
+                SidecarSection* grown = (SidecarSection*)realloc(sections, section_capacity * sizeof(SidecarSection));
+                if (grown == NULL) {
+                    goto done;
+                }
+                sections = grown;
+            }
+            SidecarSection* section = &sections[stamp->section_count++];
+            memset(section, 0, sizeof(SidecarSection));
+            size_t len = end - (line + 1);
+            memcpy(section->name, line + 1, len < MAX_INTENT - 1 ? len : MAX_INTENT - 1);
+            section->offset = ftell(file);
+            continue;
+        }
+
+        char* separator = strchr(line, '=');
+        if (separator == NULL || stamp->section_count == 0) {
+            continue;
+        }
+        *separator = '\0';
+
+        if (stamp->entry_count == entry_capacity) {
+            entry_capacity = entry_capacity == 0 ? 64 : entry_capacity * 2;
+            SidecarEntry* grown = (SidecarEntry*)realloc(entries, entry_capacity * sizeof(SidecarEntry));
+            if (grown == NULL) {
+                goto done;
+            }
+            entries = grown;
+        }
+        SidecarEntry* entry = &entries[stamp->entry_count++];
+        entry->section = stamp->section_count - 1;
+        entry->hash = sidecar_hash(sections[entry->section].name, line);
+        entry->offset = offset;
+    }
+
+    if (stamp->entry_count > 0) {
+        qsort(entries, stamp->entry_count, sizeof(SidecarEntry), sidecar_compare);
+    }
+
+    // Write the index beside the old one, then rename it into place
+    result = KB_INVALID;
+    char temp[FILENAME_MAX + 4];
+    snprintf(temp, sizeof(temp), "%s.new", path);
+    FILE* index = fopen(temp, "wb");
+    if (index != NULL) {
+        memcpy(stamp->magic, SIDECAR_MAGIC, sizeof(stamp->magic));
+        if (fwrite(stamp, sizeof(SidecarHeader), 1, index) == 1 &&
+            (stamp->section_count == 0 ||
+             fwrite(sections, sizeof(SidecarSection), stamp->section_count, index) == (size_t)stamp->section_count) &&
+            (stamp->entry_count == 0 ||
+             fwrite(entries, sizeof(SidecarEntry), stamp->entry_count, index) == (size_t)stamp->entry_count)) {
+            result = KB_OK;
+        }
+        if (fclose(index) != 0) {
+            result = KB_INVALID;
+        }
+        if (result == KB_OK && rename(temp, path) != 0) {
+            remove(path);
+            if (rename(temp, path) != 0) {
+                result = KB_INVALID;
+            }
+        }
+        if (result != KB_OK) {
+            remove(temp);
+        }
+    }
+
+done:
+    free(sections);
+    free(entries);
+    return result;
+}
+
+
+/*
+ * Open a knowledge file and its index, building the index if there is none
+ * or the file has changed since it was built.
+ *
+ * Input:
+ *   path - the name of the knowledge file
+ *
+ * Returns: the opened file, or NULL if it or its index could not be opened
+ */
+Sidecar *sidecar_open(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return NULL;
+    }
+
+    char index_path[FILENAME_MAX];
+    if (snprintf(index_path, sizeof(index_path), "%s%s", path, SIDECAR_SUFFIX) >= (int)sizeof(index_path)) {
+        return NULL;
+    }
+
+    Sidecar* sc = (Sidecar*)calloc(1, sizeof(Sidecar));
+    if (sc == NULL) {
+        return NULL;
+    }
+
+    sc->file = fopen(path, "rb");
+    if (sc->file == NULL) {
+        free(sc);
+        return NULL;
+    }
+
+    // Use the existing index if it describes this version of the file
+    SidecarHeader stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    sidecar_stamp(&st, &stamp);
+
+    sc->index = fopen(index_path, "rb");
+    if (sc->index != NULL &&
+        (fread(&sc->header, sizeof(SidecarHeader), 1, sc->index) != 1 ||
+         memcmp(sc->header.magic, SIDECAR_MAGIC, sizeof(sc->header.magic)) != 0 ||
+         sc->header.file_size != stamp.file_size ||
+         sc->header.file_mtime != stamp.file_mtime ||
+         sc->header.file_mtime_ns != stamp.file_mtime_ns ||
+         sc->header.file_id != stamp.file_id)) {
+        fclose(sc->index);
+        sc->index = NULL;
+    }
+
+    if (sc->index == NULL) {
+        if (sidecar_build(sc->file, index_path, &stamp) != KB_OK ||
+            (sc->index = fopen(index_path, "rb")) == NULL ||
+            fread(&sc->header, sizeof(SidecarHeader), 1, sc->index) != 1) {
+            sidecar_close(sc);
+            return NULL;
+        }
+    }
+
+    // Keep the (few) sections in memory; the entries stay on disk
+    int count = sc->header.section_count;
+    sc->sections = (SidecarSection*)malloc((count > 0 ? count : 1) * sizeof(SidecarSection));
+    sc->section_loaded = (char*)calloc(count > 0 ? count : 1, 1);
+    if (sc->sections == NULL || sc->section_loaded == NULL ||
+        fread(sc->sections, sizeof(SidecarSection), count, sc->index) != (size_t)count) {
+        sidecar_close(sc);
+        return NULL;
+    }
+    sc->entries_offset = (long)(sizeof(SidecarHeader) + count * sizeof(SidecarSection));
+
+    return sc;
+}
+
+
+/*
+ * Open a second stream onto the file an open stream reads.
+ *
+ * Returns: the new stream, or NULL if it could not be opened
+ */
+static FILE* sidecar_reopen(FILE *f) {
+#ifdef _WIN32
+    int fd = _dup(_fileno(f));
+    FILE* copy = fd >= 0 ? _fdopen(fd, "rb") : NULL;
+    if (copy == NULL && fd >= 0) {
+        _close(fd);
+    }
+#else
+    int fd = dup(fileno(f));
+    FILE* copy = fd >= 0 ? fdopen(fd, "rb") : NULL;
+    if (copy == NULL && fd >= 0) {
+        close(fd);
+    }
+#endif
+    return copy;
+}
+
+
+/*
+ * Open a second handle onto the same version of a knowledge file and its
+ * index, even if either has been replaced since. The new handle starts with
+ * the same sections read as the original, and from then on keeps its own
+ * record of them. The two share file positions, so they must not be used
+ * from different threads at once.
+ *
+ * Input:
+ *   sc - the opened file
+ *
+ * Returns: the new handle, or NULL if it could not be opened
+ */
+Sidecar *sidecar_dup(Sidecar *sc) {
+    Sidecar* copy = (Sidecar*)calloc(1, sizeof(Sidecar));
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    int count = sc->header.section_count;
+    copy->header = sc->header;
+    copy->entries_offset = sc->entries_offset;
+    copy->sections = (SidecarSection*)malloc((count > 0 ? count : 1) * sizeof(SidecarSection));
+    copy->section_loaded = (char*)malloc(count > 0 ? count : 1);
+    copy->file = sidecar_reopen(sc->file);
+    copy->index = sidecar_reopen(sc->index);
+    if (copy->sections == NULL || copy->section_loaded == NULL || copy->file == NULL || copy->index == NULL) {
+        sidecar_close(copy);
+        return NULL;
+    }
+
+    memcpy(copy->sections, sc->sections, count * sizeof(SidecarSection));
+    memcpy(copy->section_loaded, sc->section_loaded, count);
+    return copy;
+}
+
+
+/*
+ * Close a knowledge file and its index.
+ */
+void sidecar_close(Sidecar *sc) {
+    if (sc == NULL) {
+        return;
+    }
+
+    if (sc->file != NULL) {
+        fclose(sc->file);
+    }
+    if (sc->index != NULL) {
+        fclose(sc->index);
+    }
+    free(sc->sections);
+    free(sc->section_loaded);
+    free(sc);
+}
+
+
+/*
+ * Read the i-th entry of the index.
+ */
+static int sidecar_entry(Sidecar *sc, int i, SidecarEntry *entry) {
+    return fseek(sc->index, sc->entries_offset + (long)i * (long)sizeof(SidecarEntry), SEEK_SET) == 0 &&
+           fread(entry, sizeof(SidecarEntry), 1, sc->index) == 1;
+}
+
+
+/*
+ * Read the entry for an intent and entity from a knowledge file. If the file
+ * has the same entity more than once, the last one wins.
+ *
+ * Input:
+ *   sc     - the opened file
+ *   intent - the question word
+ *   entity - the entity
+ *   insert - called with arg and the intent, entity and response of the
+ *            entry, as they are written in the file
+ *   arg    - passed to insert
+ *
+ * Returns:
+ *   KB_OK, if the entry was found
+ *   KB_NOTFOUND, if the file has no such entry
+ */
+int sidecar_find(Sidecar *sc, const char *intent, const char *entity, void (*insert)(void *, const char *, const char *, const char *), void *arg) {
+    uint32_t hash = sidecar_hash(intent, entity);
+    SidecarEntry entry;
+
+    // Find the first entry with the hash
+    int lo = 0, hi = sc->header.entry_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (!sidecar_entry(sc, mid, &entry)) {
+            return KB_NOTFOUND;
+        }
+        if (entry.hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Check each line with the hash; they are in file order
+    int result = KB_NOTFOUND;
+    int section = -1;
+    char line[MAX_LINE];
+    char found[MAX_LINE];
+    for (int i = lo; i < sc->header.entry_count && sidecar_entry(sc, i, &entry) && entry.hash == hash; i++) {
+        if (entry.section < 0 || entry.section >= sc->header.section_count ||
+            strcasecmp(sc->sections[entry.section].name, intent) != 0 ||
+            fseek(sc->file, (long)entry.offset, SEEK_SET) != 0 ||
+            !sidecar_read_line(sc->file, line, sizeof(line))) {
+            continue;
+        }
+
+        char* separator = strchr(line, '=');
+        if (separator == NULL) {
+            continue;
+        }
+        *separator = '\0';
+        if (strcasecmp(line, entity) == 0) {
+            memcpy(found, line, sizeof(line));
+            section = entry.section;
+            result = KB_OK;
+        }
+    }
+
+    if (result == KB_OK) {
+        insert(arg, sc->sections[section].name, found, found + strlen(found) + 1);
+    }
+    return result;
+}
+
+
+/*
+ * Read every entry of the sections for an intent that have not been read
+ * already.
+ *
+ * Input:
+ *   sc     - the opened file
+ *   intent - the question word, or NULL for every section
+ *   insert - called with arg and the intent, entity and response of each entry
+ *   arg    - passed to insert
+ *
+ * Returns: the number of entries read
+ */
+int sidecar_read_section(Sidecar *sc, const char *intent, void (*insert)(void *, const char *, const char *, const char *), void *arg) {
+    char line[MAX_LINE];
+    int count = 0;
+
+    for (int i = 0; i < sc->header.section_count; i++) {
+        const SidecarSection* section = &sc->sections[i];
+        if (sc->section_loaded[i] || (intent != NULL && strcasecmp(section->name, intent) != 0)) {
+            continue;
+        }
+        sc->section_loaded[i] = 1;
+
+        if (fseek(sc->file, (long)section->offset, SEEK_SET) != 0) {
+            continue;
+        }
+        while (sidecar_read_line(sc->file, line, sizeof(line)) && line[0] != '[') {
+            char* separator = strchr(line, '=');
+            if (separator != NULL) {
+                *separator = '\0';
+                insert(arg, section->name, line, separator + 1);
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,568 @@
+/* -----------------------------------------------------------------------------
+   Chatbot entity spotting.
+   Team ID:
+   Team Name:
+   Filename:     spot.c
+   Version:      2024-1.0
+   Description:  C source for the entity spotter in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file implements an Aho-Corasick automaton over every entity in the
+ * knowledge base. It finds the entities mentioned anywhere in a line of free
+ * text, such as "what do you know about ICT1503C and SIT", in a single pass
+ * over the line whose cost does not depend on how many entities are known.
+ *
+ * spot_create() makes an empty spotter.
+ * spot_add() adds an entity.
+ * spot_find() finds the longest entity mentioned in some text.
+ * spot_clear() empties the spotter.
+ * spot_destroy() frees the spotter.
+ *
+ * Entities are stored upper-cased in a trie whose edges live in one
+ * open-addressed table keyed by (parent, character). The failure links are
+ * computed for the whole trie in one breadth-first pass by the first
+ * spot_find() after the spotter is filled. After that, an added entity gets
+ * links for its own new nodes straight away, which keeps every earlier
+ * entity findable, and goes on a short pending list that spot_find() checks
+ * directly, since older nodes do not yet link to it. The full pass is only
+ * repeated once the pending list outgrows a bound that grows with the trie,
+ * so a stream of single additions does not rebuild the automaton each time.
+ */
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chat1503C.h"
+
+/* the most distinct intents a spotter can tell apart */
+#define SPOT_MAX_INTENTS 256
+
+/* initial capacity of the node, edge and output tables (must be a power of two) */
+#define SPOT_INITIAL     64
+
+/* the failure links are rebuilt once more than SPOT_PENDING_MIN entities,
+   plus one for every SPOT_PENDING_RATIO nodes, have been added since */
+#define SPOT_PENDING_MIN   16
+#define SPOT_PENDING_RATIO 1024
+
+
+typedef struct SpotNode {
+    int parent;
+    int fail;                       // the longest proper suffix that is also in the trie
+    int output;                     // the nearest node on the fail chain ending an entity, -1 if none
+    int child;                      // first child, -1 if none
+    int sibling;                    // next child of the same parent, -1 if none
+    int intents;                    // first SpotOutput of the entities ending here, -1 if none
+    int depth;                      // the length of the entity ending here
+    unsigned char ch;               // the character on the edge from the parent
+} SpotNode;
+
+// One intent an entity is known under
+typedef struct SpotOutput {
+    int intent;                     // index into intents
+    int next;                       // next SpotOutput of the same node, -1 if none
+} SpotOutput;
+
+struct EntitySpotter {
+    SpotNode* nodes;                // node 0 is the root
+    int node_count;
+    int node_capacity;
+
+    int* edges;                     // (parent, character) -> child, -1 if empty
+    int edge_capacity;
+
+    SpotOutput* outputs;
+    int output_count;
+    int output_capacity;
+
+    char intents[SPOT_MAX_INTENTS][MAX_INTENT];
+    int intent_count;
+
+    int* queue;                     // breadth-first order for spot_build()
+    int built;                      // 0 if the failure links have not been computed since the spotter was cleared
+
+    int* pending;                   // the nodes that began ending an entity since the last spot_build()
+    int pending_count;
+    int pending_capacity;
+};
+
+
+/*
+ * Find the edge table slot for a character leaving a node.
+ *
+ * Returns: the slot holding the child, or the empty slot where it belongs
+ */
+static int spot_edge_slot(const EntitySpotter *sp, int parent, unsigned char ch) {
+    unsigned long hash = ((unsigned long)parent * 2654435761UL) ^ ch;
+    int mask = sp->edge_capacity - 1;
+    int i = (int)(hash & mask);
+
+    while (sp->edges[i] >= 0) {
+        const SpotNode* node = &sp->nodes[sp->edges[i]];
+        if (node->parent == parent && node->ch == ch) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+
+/*
+ * Follow the edge for a character leaving a node.
+ *
+ * Returns: the child, or -1 if there is no such edge
+ */
+static int spot_child(const EntitySpotter *sp, int parent, unsigned char ch) {
+    return sp->edges[spot_edge_slot(sp, parent, ch)];
+}
+
+
+/*
+ * Double the size of the edge table.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int spot_grow_edges(EntitySpotter *sp) {
+    int* old = sp->edges;
+
+    sp->edges = (int*)malloc(sp->edge_capacity * 2 * sizeof(int));
+    if (sp->edges == NULL) {
+        sp->edges = old;
+        return KB_NOMEM;
+    }
+    sp->edge_capacity *= 2;
+    memset(sp->edges, 0xFF, sp->edge_capacity * sizeof(int));
+
+    // Every node but the root is the target of exactly one edge
+    for (int i = 1; i < sp->node_count; i++) {
+        sp->edges[spot_edge_slot(sp, sp->nodes[i].parent, sp->nodes[i].ch)] = i;
+    }
+    free(old);
+    return KB_OK;
+}
+
+
+/*
+ * Add a node below a parent.
+ *
+ * Returns: the new node, or -1 if there was a memory allocation failure
+ */
+static int spot_new_node(EntitySpotter *sp, int parent, unsigned char ch) {
+    if (sp->node_count == sp->node_capacity) {
+        SpotNode* nodes = (SpotNode*)realloc(sp->nodes, sp->node_capacity * 2 * sizeof(SpotNode));
+        if (nodes == NULL) {
+            return -1;
+        }
+        sp->nodes = nodes;
+        sp->node_capacity *= 2;
+    }
+    if ((sp->node_count + 1) * 2 > sp->edge_capacity && spot_grow_edges(sp) != KB_OK) {
+        return -1;
+    }
+
+    int id = sp->node_count++;
+    SpotNode* node = &sp->nodes[id];
+    node->parent = parent;
+    node->fail = 0;
+    node->output = -1;
+    node->child = -1;
+    node->intents = -1;
+    node->ch = ch;
+    node->depth = parent < 0 ? 0 : sp->nodes[parent].depth + 1;
+    if (parent >= 0) {
+        node->sibling = sp->nodes[parent].child;
+        sp->nodes[parent].child = id;
+        sp->edges[spot_edge_slot(sp, parent, ch)] = id;
+    } else {
+        node->sibling = -1;
+    }
+    return id;
+}
+
+
+/*
+ * Find the index of an intent's name.
+ *
+ * Input:
+ *   add - 1 to add the intent if it is new, 0 to leave the table alone
+ *
+ * Returns: the index, or -1 if the intent is unknown (or the table is full)
+ */
+static int spot_intent(EntitySpotter *sp, const char *intent, int add) {
+    for (int i = 0; i < sp->intent_count; i++) {
+        if (strcasecmp(sp->intents[i], intent) == 0) {
+            return i;
+        }
+    }
+
+    if (!add || sp->intent_count == SPOT_MAX_INTENTS) {
+        return -1;
+    }
+    strncpy(sp->intents[sp->intent_count], intent, MAX_INTENT - 1);
+    sp->intents[sp->intent_count][MAX_INTENT - 1] = '\0';
+    return sp->intent_count++;
+}
+
+
+/*
+ * Compute the failure and output links of every node, parents before
+ * children.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int spot_build(EntitySpotter *sp) {
+    int* queue = (int*)realloc(sp->queue, sp->node_capacity * sizeof(int));
+    if (queue == NULL) {
+        return KB_NOMEM;
+    }
+    sp->queue = queue;
+
+    int head = 0, tail = 0;
+    sp->nodes[0].output = -1;
+    for (int c = sp->nodes[0].child; c >= 0; c = sp->nodes[c].sibling) {
+        sp->nodes[c].fail = 0;
+        queue[tail++] = c;
+    }
+
+    while (head < tail) {
+        int u = queue[head++];
+        SpotNode* node = &sp->nodes[u];
+        node->output = node->intents >= 0 ? u : sp->nodes[node->fail].output;
+
+        for (int c = node->child; c >= 0; c = sp->nodes[c].sibling) {
+            // The child's failure link extends the longest suffix of u that
+            // can be followed by the same character
+            int f = node->fail;
+            int next = spot_child(sp, f, sp->nodes[c].ch);
+            while (next < 0 && f != 0) {
+                f = sp->nodes[f].fail;
+                next = spot_child(sp, f, sp->nodes[c].ch);
+            }
+            sp->nodes[c].fail = next >= 0 ? next : 0;
+            queue[tail++] = c;
+        }
+    }
+
+    sp->built = 1;
+    sp->pending_count = 0;
+    return KB_OK;
+}
+
+
+/*
+ * Compute the failure and output links of a node added after spot_build(),
+ * from those of its parent. The links only account for the nodes that were
+ * in the trie when the parent's links were computed, which is enough to find
+ * every entity that was known then.
+ */
+static void spot_link(EntitySpotter *sp, int c) {
+    int u = sp->nodes[c].parent;
+    unsigned char ch = sp->nodes[c].ch;
+
+    int fail = 0;
+    if (u != 0) {
+        int f = sp->nodes[u].fail;
+        int next = spot_child(sp, f, ch);
+        while (next < 0 && f != 0) {
+            f = sp->nodes[f].fail;
+            next = spot_child(sp, f, ch);
+        }
+        fail = next >= 0 ? next : 0;
+    }
+    sp->nodes[c].fail = fail;
+    sp->nodes[c].output = sp->nodes[c].intents >= 0 ? c : sp->nodes[fail].output;
+}
+
+
+/*
+ * Find the first whole-word mention of a pending entity in some text.
+ *
+ * Input:
+ *   node - the node ending the entity
+ *   len  - the length of the text
+ *
+ * Returns: the position of the mention, or -1 if there is none
+ */
+static int spot_find_pending(const EntitySpotter *sp, int node, const char *text, int len) {
+    char pattern[MAX_ENTITY];
+    int depth = sp->nodes[node].depth;
+    if (depth >= MAX_ENTITY) {
+        return -1;
+    }
+    for (int u = node, i = depth - 1; u > 0; u = sp->nodes[u].parent, i--) {
+        pattern[i] = (char)sp->nodes[u].ch;
+    }
+
+    for (int start = 0; start + depth <= len; start++) {
+        int j = 0;
+        while (j < depth && (unsigned char)toupper((unsigned char)text[start + j]) == (unsigned char)pattern[j]) {
+            j++;
+        }
+        int end = start + depth;
+        if (j == depth &&
+            !(start > 0 && isalnum((unsigned char)text[start - 1]) && isalnum((unsigned char)text[start])) &&
+            !(isalnum((unsigned char)text[end - 1]) && isalnum((unsigned char)text[end]))) {
+            return start;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Create an empty spotter.
+ *
+ * Returns: the spotter, or NULL if there was a memory allocation failure
+ */
+EntitySpotter *spot_create() {
+    EntitySpotter* sp = (EntitySpotter*)calloc(1, sizeof(EntitySpotter));
+    if (sp == NULL) {
+        return NULL;
+    }
+
+    sp->nodes = (SpotNode*)malloc(SPOT_INITIAL * sizeof(SpotNode));
+    sp->edges = (int*)malloc(SPOT_INITIAL * sizeof(int));
+    sp->outputs = (SpotOutput*)malloc(SPOT_INITIAL * sizeof(SpotOutput));
+    if (sp->nodes == NULL || sp->edges == NULL || sp->outputs == NULL) {
+        free(sp->nodes);
+        free(sp->edges);
+        free(sp->outputs);
+        free(sp);
+        return NULL;
+    }
+    sp->node_capacity = SPOT_INITIAL;
+    sp->edge_capacity = SPOT_INITIAL;
+    sp->output_capacity = SPOT_INITIAL;
+
+    spot_clear(sp);
+    return sp;
+}
+
+
+/*
+ * Remove every entity from a spotter.
+ */
+void spot_clear(EntitySpotter *sp) {
+    if (sp == NULL) {
+        return;
+    }
+
+    memset(sp->edges, 0xFF, sp->edge_capacity * sizeof(int));
+    sp->node_count = 0;
+    sp->output_count = 0;
+    sp->intent_count = 0;
+    spot_new_node(sp, -1, 0);
+    sp->built = 0;
+    sp->pending_count = 0;
+}
+
+
+/*
+ * Free a spotter.
+ */
+void spot_destroy(EntitySpotter *sp) {
+    if (sp == NULL) {
+        return;
+    }
+
+    free(sp->nodes);
+    free(sp->edges);
+    free(sp->outputs);
+    free(sp->queue);
+    free(sp->pending);
+    free(sp);
+}
+
+
+/*
+ * Add an entity to a spotter. Adding an entity that is already known under
+ * the same intent does nothing.
+ *
+ * Input:
+ *   sp     - the spotter
+ *   intent - the question word the entity is known under
+ *   entity - the entity
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the inputs are invalid
+ *   KB_NOMEM, if there was a memory allocation failure (the entity cannot be spotted)
+ */
+int spot_add(EntitySpotter *sp, const char *intent, const char *entity) {
+    if (sp == NULL || intent == NULL || entity == NULL || entity[0] == '\0') {
+        return KB_INVALID;
+    }
+
+    int id = spot_intent(sp, intent, 1);
+    if (id < 0) {
+        return KB_NOMEM;
+    }
+
+    int u = 0;
+    for (int i = 0; entity[i] != '\0'; i++) {
+        unsigned char ch = (unsigned char)toupper((unsigned char)entity[i]);
+        int next = spot_child(sp, u, ch);
+        if (next < 0) {
+            next = spot_new_node(sp, u, ch);
+            if (next < 0) {
+                return KB_NOMEM;
+            }
+            if (sp->built) {
+                spot_link(sp, next);
+            }
+        }
+        u = next;
+    }
+
+    for (int o = sp->nodes[u].intents; o >= 0; o = sp->outputs[o].next) {
+        if (sp->outputs[o].intent == id) {
+            return KB_OK;
+        }
+    }
+
+    if (sp->output_count == sp->output_capacity) {
+        SpotOutput* outputs = (SpotOutput*)realloc(sp->outputs, sp->output_capacity * 2 * sizeof(SpotOutput));
+        if (outputs == NULL) {
+            return KB_NOMEM;
+        }
+        sp->outputs = outputs;
+        sp->output_capacity *= 2;
+    }
+
+    // A node that starts ending an entity is missing from the output links
+    // of the nodes that fail to it until the next spot_build()
+    if (sp->nodes[u].intents < 0 && sp->built) {
+        if (sp->pending_count == sp->pending_capacity) {
+            int capacity = sp->pending_capacity == 0 ? SPOT_PENDING_MIN : sp->pending_capacity * 2;
+            int* pending = (int*)realloc(sp->pending, capacity * sizeof(int));
+            if (pending == NULL) {
+                sp->built = 0;
+            } else {
+                sp->pending = pending;
+                sp->pending_capacity = capacity;
+            }
+        }
+        if (sp->built) {
+            sp->pending[sp->pending_count++] = u;
+            sp->nodes[u].output = u;
+        }
+    }
+
+    sp->outputs[sp->output_count].intent = id;
+    sp->outputs[sp->output_count].next = sp->nodes[u].intents;
+    sp->nodes[u].intents = sp->output_count++;
+    return KB_OK;
+}
+
+
+/*
+ * Find the longest entity known under an intent that is mentioned in some
+ * text, matching whole words only and ignoring case. Of equally long
+ * mentions, the first one wins.
+ *
+ * Input:
+ *   sp     - the spotter
+ *   intent - the question word
+ *   text   - the text
+ *   entity - a buffer to receive the mention, as written in the text
+ *   n      - the maximum number of characters to write to the entity buffer
+ *
+ * Returns:
+ *   KB_OK, if an entity was found
+ *   KB_NOTFOUND, if the text mentions no entity known under the intent
+ *   KB_INVALID, if the inputs are invalid
+ *   KB_NOMEM, if there was a memory allocation failure
+ */
+int spot_find(EntitySpotter *sp, const char *intent, const char *text, char *entity, int n) {
+    if (sp == NULL || intent == NULL || text == NULL || entity == NULL || n <= 0) {
+        return KB_INVALID;
+    }
+
+    int id = spot_intent(sp, intent, 0);
+    if (id < 0) {
+        return KB_NOTFOUND;
+    }
+    if ((!sp->built || sp->pending_count > SPOT_PENDING_MIN + sp->node_count / SPOT_PENDING_RATIO) &&
+        spot_build(sp) != KB_OK) {
+        return KB_NOMEM;
+    }
+
+    int best_start = -1, best_len = 0;
+    int u = 0;
+    for (int i = 0; text[i] != '\0'; i++) {
+        unsigned char ch = (unsigned char)toupper((unsigned char)text[i]);
+        int next = spot_child(sp, u, ch);
+        while (next < 0 && u != 0) {
+            u = sp->nodes[u].fail;
+            next = spot_child(sp, u, ch);
+        }
+        u = next >= 0 ? next : 0;
+
+        // Only mentions ending at a word boundary count
+        if (isalnum((unsigned char)text[i]) && isalnum((unsigned char)text[i + 1])) {
+            continue;
+        }
+
+        // The output chain lists every entity ending here, longest first
+        for (int o = sp->nodes[u].output; o >= 0; o = sp->nodes[sp->nodes[o].fail].output) {
+            int len = sp->nodes[o].depth;
+            int start = i + 1 - len;
+            if (len <= best_len) {
+                break;
+            }
+            if (start > 0 && isalnum((unsigned char)text[start - 1]) && isalnum((unsigned char)text[start])) {
+                continue;
+            }
+
+            int known = 0;
+            for (int k = sp->nodes[o].intents; k >= 0 && !known; k = sp->outputs[k].next) {
+                known = sp->outputs[k].intent == id;
+            }
+            if (known) {
+                best_start = start;
+                best_len = len;
+                break;
+            }
+        }
+    }
+
+    // Entities added since the last build may be missed above
+    int text_len = (int)strlen(text);
+    for (int p = 0; p < sp->pending_count; p++) {
+        int node = sp->pending[p];
+        int len = sp->nodes[node].depth;
+        if (len < best_len) {
+            continue;
+        }
+
+        int known = 0;
+        for (int k = sp->nodes[node].intents; k >= 0 && !known; k = sp->outputs[k].next) {
+            known = sp->outputs[k].intent == id;
+        }
+        int start = known ? spot_find_pending(sp, node, text, text_len) : -1;
+        if (start >= 0 && (len > best_len || start < best_start)) {
+            best_start = start;
+            best_len = len;
+        }
+    }
+
+    if (best_start < 0) {
+        return KB_NOTFOUND;
+    }
+
+    int len = best_len < n - 1 ? best_len : n - 1;
+    memcpy(entity, text + best_start, len);
+    entity[len] = '\0';
+    return KB_OK;
+}
@@ -0,0 +1,225 @@
+/* -----------------------------------------------------------------------------
+   Chatbot knowledge base regression tests.
+   Team ID:
+   Team Name:
+   Filename:     knowledge_test.c
+   Version:      2024-1.0
+   Description:  Regression tests for the knowledge base in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This program checks behaviour of the knowledge base that has been broken
+ * before. Build and run it from this directory with
+ *
+ *   gcc -std=gnu11 -I.. -o knowledge_test knowledge_test.c ../knowledge.c
+ *       ../search.c ../spot.c ../sidecar.c ../misses.c ../vector.c ../shared.c
+ *       -lpthread -lm
+ *   ./knowledge_test
+ *
+ * It works on scratch files named "knowledge_test.*" in the current
+ * directory, and exits with the number of failed checks.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chat1503C.h"
+
+#define TEST_FILE "knowledge_test.ini"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+
+/*
+ * Start a scratch knowledge file with the given contents.
+ */
+static void test_start(const char *contents) {
+    remove(TEST_FILE ".delta");
+    remove(TEST_FILE ".idx");
+    remove(TEST_FILE ".misses");
+    FILE* f = fopen(TEST_FILE, "w");
+    fputs(contents, f);
+    fclose(f);
+}
+
+
+/*
+ * Remove the scratch files.
+ */
+static void test_finish() {
+    remove(TEST_FILE);
+    remove(TEST_FILE ".delta");
+    remove(TEST_FILE ".idx");
+    remove(TEST_FILE ".misses");
+    remove(TEST_FILE ".log");
+    remove(TEST_FILE ".snapshot");
+}
+
+
+/*
+ * Answers learned at close to the longest allowed come back whole from the
+ * delta file, and their text is never read as further entries; nor is the
+ * tail of a line too long to have been written by the chatbot.
+ */
+static void test_long_answer_round_trip() {
+    char contents[1024] = "[what]\nsit=a\n";
+    memset(contents + strlen(contents), 'z', 600);
+    strcat(contents, "sit=c\n");
+    test_start(contents);
+
+    char longest[MAX_RESPONSE];
+    memset(longest, 'y', MAX_RESPONSE - 2);
+    longest[MAX_RESPONSE - 2] = '\0';
+
+    // An answer whose tail looks like an entry for another entity
+    char tricky[MAX_RESPONSE];
+    memset(tricky, 'x', 249);
+    strcpy(tricky + 249, "sit=b");
+
+    KnowledgeBase* kb = knowledge_create(TEST_FILE);
+    CHECK(knowledge_put_ctx(kb, "what", "longest", longest) == KB_OK);
+    CHECK(knowledge_put_ctx(kb, "what", "eeeee", tricky) == KB_OK);
+    knowledge_destroy(kb);
+
+    char response[MAX_RESPONSE];
+    kb = knowledge_create(TEST_FILE);
+    CHECK(knowledge_get_ctx(kb, "what", "longest", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strlen(response) == MAX_RESPONSE - 1 && strncmp(response, longest, MAX_RESPONSE - 2) == 0);
+    CHECK(knowledge_get_ctx(kb, "what", "eeeee", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strncmp(response, tricky, strlen(tricky)) == 0);
+    CHECK(knowledge_get_ctx(kb, "what", "sit", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strcmp(response, "a.") == 0);
+    knowledge_destroy(kb);
+
+    test_finish();
+}
+
+
+/*
+ * A follower bootstrapped from a leader's snapshot holds the same long
+ * entries as the leader, and no extra ones made from their text.
+ */
+static void test_follower_snapshot_long_entries() {
+    test_start("[what]\nsit=a\n");
+
+    char tricky[MAX_RESPONSE];
+    memset(tricky, 'x', 249);
+    strcpy(tricky + 249, "sit=b");
+
+    KnowledgeBase* leader = knowledge_create(TEST_FILE);
+    CHECK(knowledge_publish_ctx(leader, TEST_FILE ".log") == KB_OK);
+    CHECK(knowledge_put_ctx(leader, "what", "eeeee", tricky) == KB_OK);
+    FILE* f = fopen(TEST_FILE ".snapshot", "w");
+    knowledge_write_ctx(leader, f);
+    fclose(f);
+
+    // Changes after the snapshot reach the follower through the log
+    CHECK(knowledge_put_ctx(leader, "what", "later", "c") == KB_OK);
+
+    char response[MAX_RESPONSE];
+    KnowledgeBase* follower = knowledge_create(TEST_FILE ".follower");
+    CHECK(knowledge_follow_ctx(follower, TEST_FILE ".log", TEST_FILE ".snapshot") == KB_OK);
+    CHECK(knowledge_get_ctx(follower, "what", "eeeee", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strncmp(response, tricky, strlen(tricky)) == 0);
+    CHECK(knowledge_get_ctx(follower, "what", "sit", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strcmp(response, "a.") == 0);
+    CHECK(knowledge_get_ctx(follower, "what", "later", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strcmp(response, "c.") == 0);
+    knowledge_destroy(follower);
+    knowledge_destroy(leader);
+
+    test_finish();
+}
+
+
+/*
+ * Count the lines of a file, or return -1 if it does not exist.
+ */
+static int test_count_lines(const char *path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int lines = 0, c;
+    while ((c = getc(f)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(f);
+    return lines;
+}
+
+
+/*
+ * The unanswered questions are written out as soon as there is one, and
+ * again when the knowledge base is destroyed, however short the session.
+ */
+static void test_misses_dumped() {
+    test_start("[what]\nsit=a\n");
+
+    KnowledgeBase* kb = knowledge_create(TEST_FILE);
+    knowledge_miss_ctx(kb, "who", "the dean", "who is the dean");
+    CHECK(test_count_lines(TEST_FILE ".misses") == 1);
+    knowledge_miss_ctx(kb, "where", "mars", "where is mars");
+    knowledge_destroy(kb);
+    CHECK(test_count_lines(TEST_FILE ".misses") == 2);
+
+    test_finish();
+}
+
+
+/*
+ * Answering by meaning takes a paraphrase that names part of an entity, but
+ * not a question that only shares a word with some response.
+ */
+static void test_similar_threshold() {
+    test_start("[what]\n"
+               "ICT1504C=Logic and Discrete Structures.\n"
+               "ICT1503C=Programming Fundamentals in C.\n"
+               "ICT1502C=IT Fundamentals.\n"
+               "ICT1501C=Digital Fundamentals.\n"
+               "ICT Cluster=ICT Cluster offers degrees in computer engineering, software engineering, "
+               "information security, computing, and artificial intelligence.\n"
+               "SIT=SIT is an autonomous university in Singapore.\n"
+               "\n"
+               "[where]\n"
+               "ICT Cluster=All ICT programmes are now taught at SIT@Punggol.\n"
+               "SIT=SIT has campuses at each of Singapore's polytechnics, a transitional campus at Dover, "
+               "and a new main campus at Punggol.\n");
+
+    char response[MAX_RESPONSE];
+    KnowledgeBase* kb = knowledge_create(TEST_FILE);
+    CHECK(knowledge_similar_ctx(kb, "where", "do ICT students study", response, MAX_RESPONSE) == KB_OK);
+    CHECK(strcmp(response, "All ICT programmes are now taught at SIT@Punggol.") == 0);
+    CHECK(knowledge_similar_ctx(kb, "what", "a computer", response, MAX_RESPONSE) == KB_NOTFOUND);
+    knowledge_destroy(kb);
+
+    test_finish();
+}
+
+
+int main() {
+    test_long_answer_round_trip();
+    test_follower_snapshot_long_entries();
+    test_misses_dumped();
+    test_similar_threshold();
+
+    printf("%s\n", failures == 0 ? "All checks passed." : "Some checks failed.");
+    return failures;
+}
@@ -0,0 +1,412 @@
+/* -----------------------------------------------------------------------------
+   Chatbot transcript logging.
+   Team ID:
+   Team Name:
+   Filename:     transcript.c
+   Version:      2024-1.0
+   Description:  C source for the transcript logger in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file keeps a transcript of every line said to and by the chatbot,
+ * without making the conversation wait for the disk.
+ *
+ * transcript_open() starts a transcript in a file.
+ * transcript_log() records one line.
+ * transcript_dropped() counts the lines that could not be recorded.
+ * transcript_close() writes out what is left and stops.
+ *
+ * transcript_log() only copies the line and the time into a fixed-size
+ * record in a ring of TRANSCRIPT_RING records, which any number of threads
+ * may do at once without a lock: each claims the next record by advancing
+ * the ring's tail with a compare-and-swap, and marks the record ready with
+ * its sequence number once it is filled in. A background thread takes the
+ * ready records in order, formats them with their timestamps into a large
+ * buffer, and writes the buffer with one fwrite() per batch.
+ *
+ * If the ring is full because the disk cannot keep up, the line is either
+ * dropped and counted (TRANSCRIPT_DROP), or the caller waits for room
+ * (TRANSCRIPT_BLOCK). Dropped lines are noted in the transcript itself.
+ *
+ * Before a line would take the file past a given size, the file is renamed
+ * "path.1" (after "path.1" is renamed "path.2", and so on up to
+ * TRANSCRIPT_KEEP) and a new one is started with that line.
+ *
+ * If compiled with KB_NO_THREADS, lines are written as they are logged.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef KB_NO_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include "chat1503C.h"
+
+/* the number of records in the ring (a power of two) */
+#define TRANSCRIPT_RING     4096
+
+/* the maximum number of characters in a speaker's name (including the terminating null) */
+#define TRANSCRIPT_SPEAKER  16
+
+/* the size of the buffer records are formatted into before being written */
+#define TRANSCRIPT_BATCH    (64 * 1024)
+
+/* the number of rotated files kept */
+#define TRANSCRIPT_KEEP     5
+
+/* microseconds the background thread sleeps when there is nothing to write */
+#define TRANSCRIPT_IDLE     2000
+
+
+typedef struct TranscriptRecord {
+    unsigned long seq;              // the position the record is ready to be taken from
+    time_t seconds;                 // when it was logged
+    long millis;
+    char speaker[TRANSCRIPT_SPEAKER];
+    char text[MAX_RESPONSE];
+} TranscriptRecord;
+
+struct TranscriptLog {
+    char path[FILENAME_MAX];
+    FILE* file;
+    long size;                      // of the file so far
+    long rotate;                    // the size to rotate the file at, or 0 never to
+    int policy;
+
+    TranscriptRecord ring[TRANSCRIPT_RING];
+    unsigned long tail;             // the next position to log to (shared by every thread)
+    unsigned long head;             // the next position to write out (background thread only)
+    unsigned long dropped;
+    unsigned long dropped_noted;    // the number of dropped lines already noted in the file
+
+    char batch[TRANSCRIPT_BATCH];
+    int batch_len;
+
+#ifndef KB_NO_THREADS
+    pthread_t thread;
+    int stopping;
+#endif
+};
+
+
+/*
+ * Get the current time to the millisecond.
+ */
+static void transcript_now(time_t *seconds, long *millis) {
+#if defined(TIME_UTC) && !defined(_WIN32)
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    *seconds = ts.tv_sec;
+    *millis = ts.tv_nsec / 1000000;
+#else
+    *seconds = time(NULL);
+    *millis = 0;
+#endif
+}
+
+
+/*
+ * Rename the file to "path.1" (shifting the older ones along) and start a
+ * new one.
+ */
+static void transcript_rotate(TranscriptLog *tl) {
+    fclose(tl->file);
+
+    char from[FILENAME_MAX + 8], to[FILENAME_MAX + 8];
+    for (int i = TRANSCRIPT_KEEP - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", tl->path, i);
+        snprintf(to, sizeof(to), "%s.%d", tl->path, i + 1);
+        remove(to);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", tl->path);
+    remove(to);
+    rename(tl->path, to);
+
+    tl->file = fopen(tl->path, "a");
+    tl->size = 0;
+}
+
+
+/*
+ * Write out the formatted records.
+ */
+static void transcript_flush(TranscriptLog *tl) {
+    if (tl->batch_len == 0) {
+        return;
+    }
+
+    if (tl->file != NULL) {
+        fwrite(tl->batch, 1, tl->batch_len, tl->file);
+        fflush(tl->file);
+    }
+    tl->size += tl->batch_len;
+    tl->batch_len = 0;
+}
+
+
+/*
+ * Format one line of the transcript into the batch, writing the batch out
+ * first if the line will not fit, and rotating the file first if the line
+ * would take it past its size.
+ */
+static void transcript_format(TranscriptLog *tl, time_t seconds, long millis, const char *speaker, const char *text) {
+    char line[TRANSCRIPT_SPEAKER + MAX_RESPONSE + 32];
+    char stamp[24];
+    struct tm tm;
+#ifdef _WIN32
+    int ok = localtime_s(&tm, &seconds) == 0;
+#else
+    int ok = localtime_r(&seconds, &tm) != NULL;
+#endif
+    if (!ok || strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm) == 0) {
+        stamp[0] = '\0';
+    }
+    int len = snprintf(line, sizeof(line), "%s.%03ld\t%s\t%s\n", stamp, millis, speaker, text);
+    if (len < 0) {
+        return;
+    }
+    if (len >= (int)sizeof(line)) {
+        len = (int)sizeof(line) - 1;
+    }
+
+    long written = tl->size + tl->batch_len;
+    if (tl->rotate > 0 && written > 0 && written + len > tl->rotate) {
+        transcript_flush(tl);
+        transcript_rotate(tl);
+    }
+    if (tl->batch_len + len > TRANSCRIPT_BATCH) {
+        transcript_flush(tl);
+    }
+    memcpy(tl->batch + tl->batch_len, line, len);
+    tl->batch_len += len;
+}
+
+
+/*
+ * Note in the transcript any lines dropped since the last note.
+ */
+static void transcript_note_dropped(TranscriptLog *tl) {
+    unsigned long dropped = __atomic_load_n(&tl->dropped, __ATOMIC_RELAXED);
+    if (dropped == tl->dropped_noted) {
+        return;
+    }
+
+    char note[64];
+    time_t seconds;
+    long millis;
+    transcript_now(&seconds, &millis);
+    snprintf(note, sizeof(note), "%lu lines dropped", dropped - tl->dropped_noted);
+    transcript_format(tl, seconds, millis, "-", note);
+    tl->dropped_noted = dropped;
+}
+
+
+#ifndef KB_NO_THREADS
+/*
+ * Write out every record that is ready.
+ *
+ * Returns: the number of records written
+ */
+static int transcript_drain(TranscriptLog *tl) {
+    int count = 0;
+    for (;;) {
+        TranscriptRecord* record = &tl->ring[tl->head & (TRANSCRIPT_RING - 1)];
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != tl->head + 1) {
+            break;
+        }
+
+        transcript_format(tl, record->seconds, record->millis, record->speaker, record->text);
+
+        // Hand the record back to the loggers for the next time round the ring
+        __atomic_store_n(&record->seq, tl->head + TRANSCRIPT_RING, __ATOMIC_RELEASE);
+        tl->head++;
+        count++;
+    }
+
+    transcript_note_dropped(tl);
+    transcript_flush(tl);
+    return count;
+}
+
+
+/*
+ * The background thread: write out records as they become ready, until
+ * the transcript is closed and everything logged before then is written.
+ */
+static void* transcript_thread(void *arg) {
+    TranscriptLog* tl = (TranscriptLog*)arg;
+    for (;;) {
+        int stopping = __atomic_load_n(&tl->stopping, __ATOMIC_ACQUIRE);
+        if (transcript_drain(tl) == 0) {
+            if (stopping) {
+                return NULL;
+            }
+            usleep(TRANSCRIPT_IDLE);
+        }
+    }
+}
+#endif
+
+
+/*
+ * Start a transcript, appending to a file.
+ *
+ * Input:
+ *   path   - the file
+ *   policy - TRANSCRIPT_DROP to drop lines when the disk cannot keep up, or
+ *            TRANSCRIPT_BLOCK to make the chatbot wait
+ *   rotate - the size in bytes at which the file is rotated, or 0 never to
+ *            rotate it
+ *
+ * Returns: the transcript, or NULL if the file could not be opened or there
+ *          was a memory allocation failure
+ */
+TranscriptLog *transcript_open(const char *path, int policy, long rotate) {
+    if (path == NULL || strlen(path) >= FILENAME_MAX) {
+        return NULL;
+    }
+
+    TranscriptLog* tl = (TranscriptLog*)calloc(1, sizeof(TranscriptLog));
+    if (tl == NULL) {
+        return NULL;
+    }
+    strcpy(tl->path, path);
+    tl->policy = policy;
+    tl->rotate = rotate;
+
+    tl->file = fopen(path, "a");
+    if (tl->file == NULL) {
+        free(tl);
+        return NULL;
+    }
+    fseek(tl->file, 0, SEEK_END);
+    tl->size = ftell(tl->file);
+
+    // Record i is first ready to be logged to at position i
+    for (unsigned long i = 0; i < TRANSCRIPT_RING; i++) {
+        tl->ring[i].seq = i;
+    }
+
+#ifndef KB_NO_THREADS
+    if (pthread_create(&tl->thread, NULL, transcript_thread, tl) != 0) {
+        fclose(tl->file);
+        free(tl);
+        return NULL;
+    }
+#endif
+    return tl;
+}
+
+
+/*
+ * Write out everything logged so far and close the transcript.
+ */
+void transcript_close(TranscriptLog *tl) {
+    if (tl == NULL) {
+        return;
+    }
+
+#ifndef KB_NO_THREADS
+    __atomic_store_n(&tl->stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(tl->thread, NULL);
+#endif
+    transcript_note_dropped(tl);
+    transcript_flush(tl);
+    if (tl->file != NULL) {
+        fclose(tl->file);
+    }
+    free(tl);
+}
+
+
+/*
+ * Record one line of the conversation. It is written to the file later by
+ * the background thread; this only waits if the policy is TRANSCRIPT_BLOCK
+ * and the disk has fallen a whole ring behind.
+ *
+ * Input:
+ *   tl      - the transcript
+ *   speaker - who said it (at most TRANSCRIPT_SPEAKER - 1 characters are kept)
+ *   text    - what was said (at most MAX_RESPONSE - 1 characters are kept)
+ *
+ * Returns:
+ *   KB_OK, if the line was recorded
+ *   KB_NOMEM, if it was dropped because the ring was full
+ *   KB_INVALID, if the inputs are invalid
+ */
+int transcript_log(TranscriptLog *tl, const char *speaker, const char *text) {
+    if (tl == NULL || speaker == NULL || text == NULL) {
+        return KB_INVALID;
+    }
+
+    time_t seconds;
+    long millis;
+    transcript_now(&seconds, &millis);
+
+#ifndef KB_NO_THREADS
+    // Claim the record at the tail, once the background thread has taken
+    // what was there the last time round the ring
+    TranscriptRecord* record;
+    unsigned long pos = __atomic_load_n(&tl->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        record = &tl->ring[pos & (TRANSCRIPT_RING - 1)];
+        unsigned long seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        long ahead = (long)(seq - pos);
+        if (ahead == 0) {
+            if (__atomic_compare_exchange_n(&tl->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (ahead < 0) {
+            // The ring is full
+            if (tl->policy != TRANSCRIPT_BLOCK) {
+                __atomic_fetch_add(&tl->dropped, 1, __ATOMIC_RELAXED);
+                return KB_NOMEM;
+            }
+            sched_yield();
+            pos = __atomic_load_n(&tl->tail, __ATOMIC_RELAXED);
+        } else {
+            // Another thread claimed it first
+            pos = __atomic_load_n(&tl->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->seconds = seconds;
+    record->millis = millis;
+    strncpy(record->speaker, speaker, TRANSCRIPT_SPEAKER - 1);
+    record->speaker[TRANSCRIPT_SPEAKER - 1] = '\0';
+    strncpy(record->text, text, MAX_RESPONSE - 1);
+    record->text[MAX_RESPONSE - 1] = '\0';
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+#else
+    transcript_format(tl, seconds, millis, speaker, text);
+    transcript_flush(tl);
+#endif
+    return KB_OK;
+}
+
+
+/*
+ * Count the lines dropped because the disk could not keep up.
+ *
+ * Returns: the number of lines dropped since the transcript was opened
+ */
+unsigned long transcript_dropped(const TranscriptLog *tl) {
+    if (tl == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&tl->dropped, __ATOMIC_RELAXED);
+}
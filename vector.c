@@ -0,0 +1,781 @@
+/* -----------------------------------------------------------------------------
+   Chatbot vector similarity search.
+   Team ID:
+   Team Name:
+   Filename:     vector.c
+   Version:      2024-1.0
+   Description:  C source for the vector similarity index in ICT1503C Project.
+   Module:       ICT1503C
+   Prepared by:  Nicholas H L Wong
+   Organisation: Singapore Institute of Technology
+   Division:     Infocomm Technology
+   Credits:      Parts of this project are based on materials contributed to by
+                 other SIT colleagues.
+
+   -----------------------------------------------------------------------------
+ */
+
+/*
+ * This file implements an index of fixed-width vectors embedding the entity
+ * and response of every entry. It lets the chatbot answer paraphrased
+ * questions, such as "where do ICT students study", that share no exact
+ * entity and few whole words with the entry that answers them.
+ *
+ * vector_create() makes an empty index.
+ * vector_set_ivf() turns the inverted lists described below on or off.
+ * vector_add() embeds an entry, replacing any earlier version of it.
+ * vector_query() finds the entry most similar to a query.
+ * vector_names() determines whether a query shares a word with an entity.
+ * vector_clear() empties the index.
+ * vector_destroy() frees the index.
+ *
+ * Text is embedded without any model: every word, and every three-letter
+ * piece of every word, is hashed to one of VECTOR_DIM dimensions and adds
+ * +1 or -1 to it (also chosen by the hash), and the vector is then scaled
+ * to unit length. Similar wordings share many pieces, so their vectors
+ * point in similar directions, and similarity is the dot product.
+ *
+ * The vectors of each intent are stored contiguously and compared with the
+ * query one after the other, using AVX2 when the processor has it. If the
+ * index is created with inverted lists, an intent with VECTOR_IVF_MIN or more
+ * entries is also partitioned by k-means into inverted lists, and only the
+ * lists whose centroids are nearest the query are searched.
+ */
+
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chat1503C.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VECTOR_X86
+#endif
+
+/* the number of dimensions of a vector (a multiple of 32) */
+#define VECTOR_DIM       256
+
+/* how much more the words of the entity count than the words of the response */
+#define VECTOR_ENTITY_WEIGHT 2.0f
+
+/* the maximum number of characters in an embedded word (including the terminating null) */
+#define VECTOR_WORD      32
+
+/* the least number of entries of an intent that are partitioned into inverted lists */
+#define VECTOR_IVF_MIN   4096
+
+/* the most inverted lists an intent is partitioned into */
+#define VECTOR_IVF_LISTS 1024
+
+/* the number of inverted lists searched per query */
+#define VECTOR_PROBES    24
+
+/* the number of k-means rounds run when partitioning */
+#define VECTOR_ROUNDS    6
+
+/* the number of intents an index starts with room for */
+#define VECTOR_INITIAL   4
+
+
+typedef struct VectorList {
+    int* ids;                       // indexes of the vectors in the list
+    int count;
+    int capacity;
+} VectorList;
+
+// Every entry of one intent
+typedef struct VectorSet {
+    char intent[MAX_INTENT];
+    float* vectors;                 // count * VECTOR_DIM floats, one vector after the other
+    char (*entities)[MAX_ENTITY];
+    int count;
+    int capacity;
+
+    int* slots;                     // entity -> vector, -1 if empty
+    int slot_capacity;
+
+    // Inverted lists, if partitioned
+    float* centroids;               // list_count * VECTOR_DIM floats
+    VectorList* lists;
+    int* list_of;                   // the list holding each vector
+    int list_count;                 // 0 if not partitioned
+    int partitioned_count;          // count when the lists were last built
+} VectorSet;
+
+struct VectorIndex {
+    VectorSet* sets;
+    int set_count;
+    int set_capacity;
+    int ivf;                        // 0 to always search every vector
+
+    // the dot product and the scan used, chosen when the index is created
+    float (*dot)(const float *a, const float *b);
+    int (*scan)(const float *q, const float *vectors, const int *ids, int count, float *score);
+};
+
+/* words too common to say anything about an entry */
+static const char *vector_stopwords[] = {
+    "a", "an", "and", "are", "as", "at", "by", "do", "does", "for", "in", "is",
+    "it", "of", "on", "or", "the", "to", "what", "where", "who", "with", NULL
+};
+
+/*
+ * Compute the dot product of two vectors, one element at a time.
+ */
+static float vector_dot_scalar(const float *a, const float *b) {
+    float sum = 0.0f;
+    for (int i = 0; i < VECTOR_DIM; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+/*
+ * Find the vector most similar to a query, one element at a time.
+ *
+ * Input:
+ *   q       - the query
+ *   vectors - the vectors, one after the other
+ *   ids     - the indexes of the vectors to compare, or NULL to compare the first 'count'
+ *   count   - the number of vectors to compare
+ *   score   - receives the similarity of the best vector (left alone if count is 0)
+ *
+ * Returns: the index of the best vector, or -1 if count is 0
+ */
+static int vector_scan_scalar(const float *q, const float *vectors, const int *ids, int count, float *score) {
+    int best = -1;
+    float best_score = -2.0f;
+    for (int i = 0; i < count; i++) {
+        int id = ids == NULL ? i : ids[i];
+        float s = vector_dot_scalar(q, vectors + (size_t)id * VECTOR_DIM);
+        if (s > best_score) {
+            best_score = s;
+            best = id;
+        }
+    }
+    if (best >= 0) {
+        *score = best_score;
+    }
+    return best;
+}
+
+
+#ifdef VECTOR_X86
+/*
+ * Compute the dot product of two vectors, eight elements at a time.
+ */
+__attribute__((target("avx2,fma")))
+static inline float vector_dot_avx2(const float *a, const float *b) {
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+    for (int i = 0; i < VECTOR_DIM; i += 32) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+        sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), sum2);
+        sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), sum3);
+    }
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+
+/*
+ * Find the vector most similar to a query, eight elements at a time (see
+ * vector_scan_scalar()).
+ */
+__attribute__((target("avx2,fma")))
+static int vector_scan_avx2(const float *q, const float *vectors, const int *ids, int count, float *score) {
+    int best = -1;
+    float best_score = -2.0f;
+    for (int i = 0; i < count; i++) {
+        int id = ids == NULL ? i : ids[i];
+        float s = vector_dot_avx2(q, vectors + (size_t)id * VECTOR_DIM);
+        if (s > best_score) {
+            best_score = s;
+            best = id;
+        }
+    }
+    if (best >= 0) {
+        *score = best_score;
+    }
+    return best;
+}
+#endif
+
+
+/*
+ * Choose the fastest dot product and scan the processor supports for an
+ * index. The processor's features are detected by the compiler's runtime
+ * before main(), so this only reads them and any thread may call it.
+ */
+static void vector_choose_dot(VectorIndex *vx) {
+#ifdef VECTOR_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        vx->dot = vector_dot_avx2;
+        vx->scan = vector_scan_avx2;
+        return;
+    }
+#endif
+    vx->dot = vector_dot_scalar;
+    vx->scan = vector_scan_scalar;
+}
+
+
+/*
+ * Hash some characters (FNV-1a).
+ */
+static unsigned long vector_hash(const char *text, int len, unsigned long hash) {
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619UL;
+    }
+    return hash & 0xFFFFFFFFUL;
+}
+
+
+/*
+ * Add one feature to a vector being embedded.
+ */
+static void vector_feature(float *v, unsigned long hash, float weight) {
+    v[hash % VECTOR_DIM] += (hash & 0x80000000UL) ? -weight : weight;
+}
+
+
+/*
+ * Find the next word of some text that is not a stop word.
+ *
+ * Input:
+ *   p    - where to start looking
+ *   word - a buffer of VECTOR_WORD + 2 characters to receive the word,
+ *          lower-cased, after a '#' boundary mark
+ *   len  - receives the length of the word, including the mark
+ *
+ * Returns: where the word ends, or NULL if there are no more words
+ */
+static const char* vector_next_word(const char *p, char *word, int *len) {
+    for (;;) {
+        while (*p != '\0' && !isalnum((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            return NULL;
+        }
+
+        *len = 1;
+        word[0] = '#';
+        while (isalnum((unsigned char)*p)) {
+            if (*len < VECTOR_WORD) {
+                word[(*len)++] = tolower((unsigned char)*p);
+            }
+            p++;
+        }
+        word[*len] = '\0';
+
+        int stop = 0;
+        for (int i = 0; vector_stopwords[i] != NULL && !stop; i++) {
+            stop = strcmp(word + 1, vector_stopwords[i]) == 0;
+        }
+        if (!stop) {
+            return p;
+        }
+    }
+}
+
+
+/*
+ * Add the features of some text to a vector being embedded: each word that
+ * is not a stop word, and each three-letter piece of it (including its
+ * first and last letters marked as such), all scaled by a weight.
+ */
+static void vector_embed_text(float *v, const char *text, float weight) {
+    char word[VECTOR_WORD + 2];
+    int len;
+    for (const char* p = text; (p = vector_next_word(p, word, &len)) != NULL; ) {
+        vector_feature(v, vector_hash(word + 1, len - 1, 2166136261UL), weight);
+        word[len++] = '#';
+        for (int i = 0; i + 3 <= len; i++) {
+            vector_feature(v, vector_hash(word + i, 3, 84696351UL), weight * 0.5f);
+        }
+    }
+}
+
+
+/*
+ * Determine whether a query names an entity, at least in part: whether they
+ * have a word in common that is not a stop word, ignoring case.
+ *
+ * Input:
+ *   query  - the words of the query
+ *   entity - the entity
+ *
+ * Returns: 1 if they share a word, 0 otherwise
+ */
+int vector_names(const char *query, const char *entity) {
+    if (query == NULL || entity == NULL) {
+        return 0;
+    }
+
+    char word[VECTOR_WORD + 2], other[VECTOR_WORD + 2];
+    int len, other_len;
+    for (const char* p = query; (p = vector_next_word(p, word, &len)) != NULL; ) {
+        for (const char* q = entity; (q = vector_next_word(q, other, &other_len)) != NULL; ) {
+            if (strcmp(word, other) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Scale a vector to unit length.
+ *
+ * Returns: 1, or 0 if the vector is zero
+ */
+static int vector_normalize(float *v) {
+    float length = sqrtf(vector_dot_scalar(v, v));
+    if (length == 0.0f) {
+        return 0;
+    }
+    for (int i = 0; i < VECTOR_DIM; i++) {
+        v[i] /= length;
+    }
+    return 1;
+}
+
+
+/*
+ * Find the set of vectors for an intent.
+ *
+ * Returns: the set, or NULL if the intent has none
+ */
+static VectorSet* vector_find_set(const VectorIndex *vx, const char *intent) {
+    for (int i = 0; i < vx->set_count; i++) {
+        if (strcasecmp(vx->sets[i].intent, intent) == 0) {
+            return &vx->sets[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Find the slot of an entity in a set.
+ *
+ * Returns: the slot holding the entity's vector, or the empty slot where it belongs
+ */
+static int vector_slot(const VectorSet *set, const char *entity) {
+    unsigned long hash = 2166136261UL;
+    for (const char* p = entity; *p != '\0'; p++) {
+        hash ^= (unsigned char)toupper((unsigned char)*p);
+        hash *= 16777619UL;
+    }
+
+    int mask = set->slot_capacity - 1;
+    int slot = (int)(hash & mask);
+    while (set->slots[slot] >= 0 && strcasecmp(set->entities[set->slots[slot]], entity) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/*
+ * Make room for one more vector in a set.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int vector_grow_set(VectorSet *set) {
+    if (set->count == set->capacity) {
+        int capacity = set->capacity == 0 ? 64 : set->capacity * 2;
+        float* vectors = (float*)realloc(set->vectors, (size_t)capacity * VECTOR_DIM * sizeof(float));
+        if (vectors == NULL) {
+            return KB_NOMEM;
+        }
+        set->vectors = vectors;
+
+        char (*entities)[MAX_ENTITY] = realloc(set->entities, (size_t)capacity * MAX_ENTITY);
+        if (entities == NULL) {
+            return KB_NOMEM;
+        }
+        set->entities = entities;
+
+        int* list_of = (int*)realloc(set->list_of, capacity * sizeof(int));
+        if (list_of == NULL) {
+            return KB_NOMEM;
+        }
+        set->list_of = list_of;
+        set->capacity = capacity;
+    }
+
+    if ((set->count + 1) * 2 > set->slot_capacity) {
+        int* old = set->slots;
+        int old_capacity = set->slot_capacity;
+        int capacity = old_capacity == 0 ? 128 : old_capacity * 2;
+
+        set->slots = (int*)malloc(capacity * sizeof(int));
+        if (set->slots == NULL) {
+            set->slots = old;
+            return KB_NOMEM;
+        }
+        set->slot_capacity = capacity;
+        memset(set->slots, 0xFF, capacity * sizeof(int));
+        for (int i = 0; i < set->count; i++) {
+            set->slots[vector_slot(set, set->entities[i])] = i;
+        }
+        free(old);
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Find the inverted list whose centroid is nearest a vector.
+ */
+static int vector_nearest_list(const VectorIndex *vx, const VectorSet *set, const float *v) {
+    float score;
+    return vx->scan(v, set->centroids, NULL, set->list_count, &score);
+}
+
+
+/*
+ * Append a vector to an inverted list.
+ *
+ * Returns: KB_OK or KB_NOMEM
+ */
+static int vector_list_add(VectorList *list, int id) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        int* ids = (int*)realloc(list->ids, capacity * sizeof(int));
+        if (ids == NULL) {
+            return KB_NOMEM;
+        }
+        list->ids = ids;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+    return KB_OK;
+}
+
+
+/*
+ * Drop the inverted lists of a set.
+ */
+static void vector_unpartition(VectorSet *set) {
+    for (int i = 0; i < set->list_count; i++) {
+        free(set->lists[i].ids);
+    }
+    free(set->lists);
+    free(set->centroids);
+    set->lists = NULL;
+    set->centroids = NULL;
+    set->list_count = 0;
+    set->partitioned_count = 0;
+}
+
+
+/*
+ * Partition a set into inverted lists by spherical k-means, seeded with
+ * evenly spaced vectors so that the result is deterministic.
+ *
+ * Returns: KB_OK or KB_NOMEM (the set is left unpartitioned)
+ */
+static int vector_partition(const VectorIndex *vx, VectorSet *set) {
+    vector_unpartition(set);
+
+    int lists = (int)sqrt((double)set->count);
+    if (lists > VECTOR_IVF_LISTS) {
+        lists = VECTOR_IVF_LISTS;
+    }
+
+    set->centroids = (float*)malloc((size_t)lists * VECTOR_DIM * sizeof(float));
+    set->lists = (VectorList*)calloc(lists, sizeof(VectorList));
+    float* sums = (float*)malloc((size_t)lists * VECTOR_DIM * sizeof(float));
+    if (set->centroids == NULL || set->lists == NULL || sums == NULL) {
+        free(sums);
+        vector_unpartition(set);
+        return KB_NOMEM;
+    }
+    set->list_count = lists;
+
+    for (int i = 0; i < lists; i++) {
+        memcpy(set->centroids + (size_t)i * VECTOR_DIM, set->vectors + (size_t)i * (set->count / lists) * VECTOR_DIM,
+               VECTOR_DIM * sizeof(float));
+    }
+
+    for (int round = 0; round < VECTOR_ROUNDS; round++) {
+        for (int i = 0; i < set->count; i++) {
+            set->list_of[i] = vector_nearest_list(vx, set, set->vectors + (size_t)i * VECTOR_DIM);
+        }
+        if (round == VECTOR_ROUNDS - 1) {
+            break;
+        }
+
+        // Move each centroid to the direction of the mean of its vectors
+        memset(sums, 0, (size_t)lists * VECTOR_DIM * sizeof(float));
+        for (int i = 0; i < set->count; i++) {
+            float* sum = sums + (size_t)set->list_of[i] * VECTOR_DIM;
+            const float* v = set->vectors + (size_t)i * VECTOR_DIM;
+            for (int d = 0; d < VECTOR_DIM; d++) {
+                sum[d] += v[d];
+            }
+        }
+        for (int i = 0; i < lists; i++) {
+            if (vector_normalize(sums + (size_t)i * VECTOR_DIM)) {
+                memcpy(set->centroids + (size_t)i * VECTOR_DIM, sums + (size_t)i * VECTOR_DIM, VECTOR_DIM * sizeof(float));
+            }
+        }
+    }
+    free(sums);
+
+    for (int i = 0; i < set->count; i++) {
+        if (vector_list_add(&set->lists[set->list_of[i]], i) != KB_OK) {
+            vector_unpartition(set);
+            return KB_NOMEM;
+        }
+    }
+    set->partitioned_count = set->count;
+    return KB_OK;
+}
+
+
+/*
+ * Create an empty index.
+ *
+ * Input:
+ *   ivf - 1 to partition the entries of large intents into inverted lists
+ *         (faster, but may miss the best match), 0 to always compare every one
+ *
+ * Returns: the index, or NULL if there was a memory allocation failure
+ */
+VectorIndex *vector_create(int ivf) {
+    VectorIndex* vx = (VectorIndex*)calloc(1, sizeof(VectorIndex));
+    if (vx == NULL) {
+        return NULL;
+    }
+    vx->ivf = ivf;
+    vector_choose_dot(vx);
+    return vx;
+}
+
+
+/*
+ * Turn the inverted lists of an index on or off. Turning them off drops any
+ * already built; turning them on builds them at the next query of each
+ * large enough intent.
+ *
+ * Input:
+ *   vx  - the index
+ *   ivf - as vector_create()
+ */
+void vector_set_ivf(VectorIndex *vx, int ivf) {
+    if (vx == NULL) {
+        return;
+    }
+    vx->ivf = ivf;
+    if (!ivf) {
+        for (int i = 0; i < vx->set_count; i++) {
+            vector_unpartition(&vx->sets[i]);
+        }
+    }
+}
+
+
+/*
+ * Remove every entry from an index.
+ */
+void vector_clear(VectorIndex *vx) {
+    if (vx == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < vx->set_count; i++) {
+        VectorSet* set = &vx->sets[i];
+        vector_unpartition(set);
+        free(set->vectors);
+        free(set->entities);
+        free(set->slots);
+        free(set->list_of);
+    }
+    vx->set_count = 0;
+}
+
+
+/*
+ * Free an index.
+ */
+void vector_destroy(VectorIndex *vx) {
+    if (vx == NULL) {
+        return;
+    }
+
+    vector_clear(vx);
+    free(vx->sets);
+    free(vx);
+}
+
+
+/*
+ * Embed an entry, replacing the vector of any earlier version of it.
+ *
+ * Input:
+ *   vx       - the index
+ *   intent   - the question word
+ *   entity   - the entity
+ *   response - the response
+ *
+ * Returns:
+ *   KB_OK, if successful
+ *   KB_INVALID, if the inputs are invalid
+ *   KB_NOMEM, if there was a memory allocation failure (the entry cannot be found)
+ */
+int vector_add(VectorIndex *vx, const char *intent, const char *entity, const char *response) {
+    if (vx == NULL || intent == NULL || entity == NULL || response == NULL) {
+        return KB_INVALID;
+    }
+
+    VectorSet* set = vector_find_set(vx, intent);
+    if (set == NULL) {
+        if (vx->set_count == vx->set_capacity) {
+            int capacity = vx->set_capacity == 0 ? VECTOR_INITIAL : vx->set_capacity * 2;
+            VectorSet* sets = (VectorSet*)realloc(vx->sets, capacity * sizeof(VectorSet));
+            if (sets == NULL) {
+                return KB_NOMEM;
+            }
+            vx->sets = sets;
+            vx->set_capacity = capacity;
+        }
+        set = &vx->sets[vx->set_count++];
+        memset(set, 0, sizeof(VectorSet));
+        strncpy(set->intent, intent, MAX_INTENT - 1);
+    }
+
+    if (vector_grow_set(set) != KB_OK) {
+        return KB_NOMEM;
+    }
+
+    float v[VECTOR_DIM] = { 0.0f };
+    vector_embed_text(v, entity, VECTOR_ENTITY_WEIGHT);
+    vector_embed_text(v, response, 1.0f);
+    vector_normalize(v);
+
+    int slot = vector_slot(set, entity);
+    int id = set->slots[slot];
+    if (id < 0) {
+        id = set->count++;
+        set->slots[slot] = id;
+        strncpy(set->entities[id], entity, MAX_ENTITY - 1);
+        set->entities[id][MAX_ENTITY - 1] = '\0';
+    } else if (set->list_count > 0) {
+        // Take the old version out of its inverted list
+        VectorList* list = &set->lists[set->list_of[id]];
+        for (int i = 0; i < list->count; i++) {
+            if (list->ids[i] == id) {
+                list->ids[i] = list->ids[--list->count];
+                break;
+            }
+        }
+    }
+    memcpy(set->vectors + (size_t)id * VECTOR_DIM, v, sizeof(v));
+
+    if (set->list_count > 0) {
+        set->list_of[id] = vector_nearest_list(vx, set, v);
+        if (vector_list_add(&set->lists[set->list_of[id]], id) != KB_OK) {
+            vector_unpartition(set);
+        }
+    }
+    return KB_OK;
+}
+
+
+/*
+ * Find the entry most similar to a query among the entries for a question
+ * word.
+ *
+ * Input:
+ *   vx     - the index
+ *   intent - the question word
+ *   query  - the words of the query
+ *   hit    - receives the entity of the best entry and its similarity,
+ *            from -1 (opposite) through 0 (unrelated) to 1 (the same words)
+ *
+ * Returns: 1 if an entry was found that is more similar than the best of
+ *          so many unrelated entries would be by chance, 0 otherwise
+ */
+int vector_query(VectorIndex *vx, const char *intent, const char *query, SearchHit *hit) {
+    if (vx == NULL || intent == NULL || query == NULL || hit == NULL) {
+        return 0;
+    }
+
+    VectorSet* set = vector_find_set(vx, intent);
+    if (set == NULL || set->count == 0) {
+        return 0;
+    }
+
+    float q[VECTOR_DIM] = { 0.0f };
+    vector_embed_text(q, query, 1.0f);
+    if (!vector_normalize(q)) {
+        return 0;
+    }
+
+    // Large sets are searched through their inverted lists, which are
+    // rebuilt once the set has doubled in size
+    if (vx->ivf && set->count >= VECTOR_IVF_MIN && set->count >= 2 * set->partitioned_count) {
+        vector_partition(vx, set);
+    }
+
+    int best = -1;
+    float best_score = -2.0f;
+    if (set->list_count > 0) {
+        // Pick the lists with the nearest centroids
+        int probes[VECTOR_PROBES];
+        float probe_scores[VECTOR_PROBES];
+        int probe_count = 0;
+        for (int i = 0; i < set->list_count; i++) {
+            float score = vx->dot(q, set->centroids + (size_t)i * VECTOR_DIM);
+            int j = probe_count < VECTOR_PROBES ? probe_count++ : VECTOR_PROBES;
+            while (j > 0 && probe_scores[j - 1] < score) {
+                if (j < VECTOR_PROBES) {
+                    probes[j] = probes[j - 1];
+                    probe_scores[j] = probe_scores[j - 1];
+                }
+                j--;
+            }
+            if (j < VECTOR_PROBES) {
+                probes[j] = i;
+                probe_scores[j] = score;
+            }
+        }
+
+        for (int p = 0; p < probe_count; p++) {
+            const VectorList* list = &set->lists[probes[p]];
+            float score;
+            int id = vx->scan(q, set->vectors, list->ids, list->count, &score);
+            if (id >= 0 && score > best_score) {
+                best_score = score;
+                best = id;
+            }
+        }
+    } else {
+        best = vx->scan(q, set->vectors, NULL, set->count, &best_score);
+    }
+
+    // The best of many unrelated vectors is similar by chance: their
+    // similarities to the query spread about 0 with a standard deviation
+    // of about 1/sqrt(VECTOR_DIM), and the largest of n of them is about
+    // sqrt(2 ln n) standard deviations out; ask for one more to be sure
+    if (best < 0 || best_score <= (sqrt(2.0 * log((double)set->count + 1.0)) + 1.0) / sqrt((double)VECTOR_DIM)) {
+        return 0;
+    }
+    strncpy(hit->entity, set->entities[best], MAX_ENTITY - 1);
+    hit->entity[MAX_ENTITY - 1] = '\0';
+    hit->score = best_score;
+    return 1;
+}